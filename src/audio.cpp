@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+
+namespace chip8{
+    /** A fixed size queue for one producer thread and one consumer thread, without locks.
+    */
+    template<class T, size_t capacity> class spsc_ring{
+        static_assert((capacity & (capacity - 1)) == 0, "the capacity must be a power of two");
+
+        public:
+            /// returns false if the queue is full
+            bool push(const T &value){
+                size_t head = write_index.load(std::memory_order_relaxed);
+                if(head - read_index.load(std::memory_order_acquire) == capacity) return false;
+
+                items[head % capacity] = value;
+                write_index.store(head + 1, std::memory_order_release);
+                return true;
+            }
+
+            /// returns nullptr if the queue is empty, the item stays in the queue until pop()
+            const T *front(){
+                size_t tail = read_index.load(std::memory_order_relaxed);
+                if(tail == write_index.load(std::memory_order_acquire)) return nullptr;
+
+                return &items[tail % capacity];
+            }
+
+            void pop(){
+                read_index.store(read_index.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+            }
+
+        private:
+            std::array<T, capacity> items;
+            std::atomic<size_t> write_index = 0;
+            std::atomic<size_t> read_index = 0;
+    };
+
+    /** Renders the 1 bit pattern audio of CHIP-8 variants.
+    The emulator sends pattern, pitch and gate changes with a timestamp in samples of emulated time,
+    the audio thread applies each change at its sample. The emulated time advances once per frame.
+    An engine that is rendered by the emulation thread itself applies the changes at once instead, see set_synchronous().
+    */
+    class audio_engine{
+        public:
+            /**
+             * @param sample_rate output samples per second
+             * @param frame_rate emulated frames per second
+             * @param latency samples between an emulated event and its output
+             */
+            audio_engine(unsigned int sample_rate, unsigned int frame_rate, unsigned int latency) :
+                sample_rate(sample_rate), frame_rate(frame_rate), latency(latency){
+                pattern.fill(0x0f);
+                update_waveform();
+                set_frequency_now(4000.0);
+            }
+
+            /**
+             * @brief apply every change when it is sent instead of queueing it
+             *
+             * Only for an engine without latency that the emulation thread renders up to get_time() after every end_frame(),
+             * then a change takes effect at the same sample as through the queue, and none can be lost however many a frame sends.
+             */
+            void set_synchronous(bool synchronous){
+                this->synchronous = synchronous;
+            }
+
+            // producer side, called by the emulation thread
+
+            /// replace the whole pattern with a single event
+            void set_pattern(const std::array<uint8_t, 16> &p){
+                send({event_type::pattern, 0, p, 0, 0});
+            }
+
+            void set_frequency(double frequency){
+                send({event_type::frequency, 0, {}, frequency, 0});
+            }
+
+            void set_gate(bool playing){
+                send({event_type::gate, playing, {}, 0, 0});
+            }
+
+            /// move the emulated time forward by one frame
+            void end_frame(){
+                frame_remainder += sample_rate;
+                producer_time += frame_remainder / frame_rate;
+                frame_remainder %= frame_rate;
+            }
+
+            /// the emulated time in samples
+            uint64_t get_time(){
+                return producer_time;
+            }
+
+            /// number of events that were lost because the queue was full
+            uint64_t get_dropped_events(){
+                return dropped_events;
+            }
+
+            // consumer side, called by the audio thread
+
+            /// render unsigned 8 bit samples, silence is 0x80
+            void render(uint8_t *stream, size_t length){
+                for(size_t i = 0; i < length; i++){
+                    apply_events();
+
+                    stream[i] = gate ? waveform[phase >> 25] : silence;
+                    phase += phase_increment;
+                    consumer_time++;
+                }
+            }
+
+        private:
+            enum class event_type : uint8_t{pattern, frequency, gate};
+
+            struct event{
+                event_type type;
+                /// gate
+                uint8_t value;
+                std::array<uint8_t, 16> pattern;
+                double frequency;
+                /// sample at which the event takes effect
+                uint64_t time;
+            };
+
+            static constexpr uint8_t silence = 0x80;
+            static constexpr uint8_t amplitude = 0x28;
+
+            const unsigned int sample_rate, frame_rate, latency;
+
+            // producer state
+            spsc_ring<event, 1024> events;
+            uint64_t producer_time = 0;
+            uint64_t frame_remainder = 0;
+            uint64_t dropped_events = 0;
+            bool synchronous = false;
+
+            // consumer state
+            uint64_t consumer_time = 0;
+            std::array<uint8_t, 16> pattern;
+            /// one sample per pattern bit
+            std::array<uint8_t, 128> waveform;
+            /// position in the waveform, the upper 7 bits are the index
+            uint32_t phase = 0;
+            uint32_t phase_increment;
+            bool gate = false;
+
+            void send(event e){
+                e.time = producer_time + latency;
+                if(synchronous){
+                    apply_event(e);
+                    return;
+                }
+                if(!events.push(e)) dropped_events++;
+            }
+
+            void apply_event(const event &e){
+                switch(e.type){
+                    case event_type::pattern:
+                        pattern = e.pattern;
+                        update_waveform();
+                        break;
+                    case event_type::frequency:
+                        set_frequency_now(e.frequency);
+                        break;
+                    case event_type::gate:
+                        gate = e.value;
+                        break;
+                }
+            }
+
+            void apply_events(){
+                while(const event *e = events.front()){
+                    // the emulation fell behind or ran ahead too far, follow it instead of waiting
+                    if(e->time > consumer_time + 2 * latency + sample_rate / frame_rate || consumer_time > e->time + 2 * latency){
+                        consumer_time = e->time;
+                    }
+                    if(e->time > consumer_time) break;
+
+                    apply_event(*e);
+                    events.pop();
+                }
+            }
+
+            void update_waveform(){
+                for(size_t bit = 0; bit < waveform.size(); bit++){
+                    bool set = (pattern[bit >> 3] >> ((bit & 7) ^ 7)) & 1;
+                    waveform[bit] = set ? silence + amplitude : silence - amplitude;
+                }
+            }
+
+            /// the pattern is played at frequency bits per second
+            void set_frequency_now(double frequency){
+                phase_increment = static_cast<uint32_t>(std::clamp(frequency * (1 << 25) / sample_rate, 0.0, 4294967295.0));
+            }
+    };
+
+    /** Writes unsigned 8 bit mono samples into a WAV file.
+    The sizes in the header are filled in when the writer is destroyed.
+    */
+    class wav_writer{
+        public:
+            wav_writer(const std::string &filename, unsigned int sample_rate) :
+                file(filename, std::ios::binary), sample_rate(sample_rate){
+                if(!file){
+                    throw std::runtime_error("couldn't open " + filename);
+                }
+                write_header();
+            }
+
+            wav_writer(const wav_writer &) = delete;
+            wav_writer &operator=(const wav_writer &) = delete;
+
+            ~wav_writer(){
+                file.seekp(0);
+                write_header();
+            }
+
+            void write(const uint8_t *samples, size_t length){
+                file.write(reinterpret_cast<const char *>(samples), length);
+                data_size += length;
+            }
+
+        private:
+            std::ofstream file;
+            unsigned int sample_rate;
+            uint32_t data_size = 0;
+
+            /// write a little endian value
+            void write_value(uint32_t value, unsigned int bytes){
+                for(unsigned int i = 0; i < bytes; i++){
+                    file.put(static_cast<char>((value >> (i * 8)) & 0xff));
+                }
+            }
+
+            void write_header(){
+                file.write("RIFF", 4);
+                write_value(36 + data_size, 4);
+                file.write("WAVEfmt ", 8);
+                write_value(16, 4); // format chunk size
+                write_value(1, 2); // PCM
+                write_value(1, 2); // channels
+                write_value(sample_rate, 4);
+                write_value(sample_rate, 4); // bytes per second
+                write_value(1, 2); // bytes per sample
+                write_value(8, 2); // bits per sample
+                file.write("data", 4);
+                write_value(data_size, 4);
+            }
+    };
+}
@@ -0,0 +1,506 @@
+#include <cstdint>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+#include "interpreter.cpp"
+#include "audio.cpp"
+#include "frontend_headless.cpp"
+#include "input.cpp"
+
+extern "C"
+{
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+}
+
+/** Batch runner for ROM corpora.
+Runs the jobs of a manifest headless on all cores and prints one CSV line per job, in the order of the manifest.
+*/
+
+using chip8_class = chip8::chip8_interpreter<chip8::chip8_instruction_set, chip8::chip8_quirks, chip8::chip8_hardware<chip8::chip8_palette>>;
+
+/// a line of the manifest: ROM, mode, cycles and an optional input recording
+struct job{
+    /// the fields of the line, identifies the job in golden files
+    std::string name;
+    std::filesystem::path rom;
+    std::filesystem::path mode;
+    uint64_t cycles;
+    std::filesystem::path input;
+};
+
+struct job_result{
+    /// "running" if the cycles ran out, "stopped" if the program stopped, "error" on an exception
+    std::string status = "error";
+    /// the opcode before pc when the run ended
+    uint16_t opcode = 0;
+    uint64_t cycles = 0;
+    uint64_t screen_hash = 0;
+    std::string error;
+    /// screen hashes at the checkpoints, a frame number or "end"
+    std::vector<std::pair<std::string, uint64_t>> checkpoints;
+    /// "ok" or the first difference to the golden file, empty without one
+    std::string golden;
+};
+
+/// a mode of the manifest, read once before the jobs start
+struct batch_mode{
+    chip8::mode_config config;
+    uint64_t hash = 0;
+    /// set if the mode couldn't be read, its jobs fail with it
+    std::string error;
+};
+
+/** The jobs of a manifest, a line is "rom mode cycles [input]".
+Paths are relative to the manifest, empty lines and lines starting with # are skipped.
+*/
+std::vector<job> read_manifest(const std::filesystem::path &filename){
+    std::ifstream file(filename);
+    if(!file){
+        throw std::runtime_error("couldn't open " + filename.string());
+    }
+
+    std::vector<job> jobs;
+    std::filesystem::path directory = filename.parent_path();
+    std::string line;
+    for(size_t number = 1; std::getline(file, line); number++){
+        std::istringstream fields(line);
+        std::string rom, mode, cycles, input;
+        if(!(fields >> rom) || rom[0] == '#') continue;
+
+        if(!(fields >> mode >> cycles)){
+            throw std::runtime_error(filename.string() + ":" + std::to_string(number) + ": expected rom, mode and cycles");
+        }
+        fields >> input;
+
+        std::string name = rom + " " + mode + " " + cycles + (input.empty() ? "" : " " + input);
+        jobs.push_back({name, directory / rom, directory / mode, std::strtoull(cycles.c_str(), nullptr, 10), input.empty() ? std::filesystem::path() : directory / input});
+    }
+    return jobs;
+}
+
+/** Screen hashes of the jobs of a manifest at chosen frames and at the end, to test changes against.
+A line of the file is "job<tab>checkpoint<tab>hash". The screens of the checkpoints are stored as PBM images in <file>.frames,
+a comparison writes the screens that don't match into <file>.actual.
+*/
+struct golden_file{
+    std::filesystem::path filename;
+    /// record new hashes at these frames instead of comparing
+    bool update = false;
+    std::set<uint64_t> update_frames;
+    /// hashes by job name and checkpoint, separated by a tab
+    std::map<std::string, uint64_t> hashes;
+
+    static std::string key(const job &j, const std::string &checkpoint){
+        return j.name + "\t" + checkpoint;
+    }
+
+    /// the frames to hash in a job
+    std::set<uint64_t> frames(const job &j) const{
+        if(update) return update_frames;
+
+        std::set<uint64_t> result;
+        for(auto entry = hashes.lower_bound(j.name + "\t"); entry != hashes.end() && entry->first.starts_with(j.name + "\t"); entry++){
+            std::string checkpoint = entry->first.substr(j.name.size() + 1);
+            if(checkpoint != "end") result.insert(std::strtoull(checkpoint.c_str(), nullptr, 10));
+        }
+        return result;
+    }
+
+    /// the image of a checkpoint, expected or actual
+    std::filesystem::path image(const job &j, const std::string &checkpoint, bool actual) const{
+        std::ostringstream name;
+        name << std::hex << std::setw(16) << std::setfill('0') << chip8::fnv1a(j.name.data(), j.name.size()) << "-" << checkpoint << ".pbm";
+        return std::filesystem::path(filename.string() + (actual ? ".actual" : ".frames")) / name.str();
+    }
+
+    void read(){
+        std::ifstream file(filename);
+        if(!file){
+            throw std::runtime_error("couldn't open " + filename.string());
+        }
+
+        std::string line;
+        while(std::getline(file, line)){
+            size_t tab = line.rfind('\t');
+            if(line.empty() || line[0] == '#' || tab == std::string::npos) continue;
+            hashes[line.substr(0, tab)] = std::strtoull(line.c_str() + tab + 1, nullptr, 16);
+        }
+    }
+
+    void write(const std::vector<job> &jobs, const std::vector<job_result> &results) const{
+        std::ofstream file(filename);
+        file << "# chip8-batch screen hashes, update with --update-golden\n";
+        std::set<std::string> written;
+        for(size_t i = 0; i < jobs.size(); i++){
+            // a job that is listed twice gets the same hashes
+            if(!written.insert(jobs[i].name).second) continue;
+
+            for(const auto &[checkpoint, hash] : results[i].checkpoints){
+                file << key(jobs[i], checkpoint) << "\t" << std::hex << std::setw(16) << std::setfill('0') << hash << std::dec << "\n";
+            }
+        }
+        if(!file){
+            throw std::runtime_error("couldn't write " + filename.string());
+        }
+    }
+};
+
+/// write the screen planes one below the other as a binary PBM image
+template<class chip8_class> void write_pbm(const std::filesystem::path &filename, chip8_class &c8){
+    const unsigned int width = c8.get_screen_x(), height = c8.get_screen_y(), planes = c8.get_screen_planes();
+    std::ofstream file(filename, std::ios::binary);
+    file << "P4\n" << width << " " << height * planes << "\n";
+
+    std::vector<uint8_t> row((width + 7) / 8);
+    for(unsigned int plane = 0; plane < planes; plane++){
+        for(unsigned int y = 0; y < height; y++){
+            std::fill(row.begin(), row.end(), 0);
+            for(unsigned int x = 0; x < width; x++){
+                if(c8.get_pixel(plane, x, y)) row[x / 8] |= 0x80 >> (x % 8);
+            }
+            file.write(reinterpret_cast<const char *>(row.data()), row.size());
+        }
+    }
+}
+
+/** Runs the jobs 0 to count - 1 on a number of threads.
+Every thread starts with an equal share of the jobs and takes jobs from the end of the other shares once its own is done,
+so a few long jobs don't leave the other threads idle.
+*/
+class job_pool{
+    public:
+        /// call work(thread, job) for every job, returns when all are done
+        template<class function> static void run(size_t count, unsigned int threads, function work){
+            std::vector<share> shares(threads);
+            for(unsigned int t = 0; t < threads; t++){
+                for(size_t j = count * t / threads; j < count * (t + 1) / threads; j++){
+                    shares[t].jobs.push_back(j);
+                }
+            }
+
+            std::vector<std::thread> workers;
+            for(unsigned int t = 0; t < threads; t++){
+                workers.emplace_back([&shares, &work, t, threads]{
+                    size_t j;
+                    while(take(shares, t, threads, j)){
+                        work(t, j);
+                    }
+                });
+            }
+            for(std::thread &worker : workers){
+                worker.join();
+            }
+        }
+
+    private:
+        struct share{
+            std::mutex mutex;
+            std::deque<size_t> jobs;
+        };
+
+        /// the next job of the own share, else one from the end of another share, false if none is left
+        static bool take(std::vector<share> &shares, unsigned int thread, unsigned int threads, size_t &j){
+            for(unsigned int i = 0; i < threads; i++){
+                share &s = shares[(thread + i) % threads];
+                std::lock_guard<std::mutex> lock(s.mutex);
+                if(s.jobs.empty()) continue;
+
+                if(i == 0){
+                    j = s.jobs.front();
+                    s.jobs.pop_front();
+                }else{
+                    j = s.jobs.back();
+                    s.jobs.pop_back();
+                }
+                return true;
+            }
+            return false;
+        }
+};
+
+/// an interpreter and the Lua state of its mode, reused by a thread for all jobs in that mode
+struct interpreter_instance{
+    lua_State *L = nullptr;
+    std::unique_ptr<chip8_class> c8;
+
+    ~interpreter_instance(){
+        c8.reset();
+        if(L) lua_close(L);
+    }
+};
+
+/// run a job on an interpreter of its mode, golden may be nullptr
+job_result run_job(const job &j, const batch_mode &mode, chip8_class &c8, const golden_file *golden){
+    job_result result;
+    c8.reset(mode.config);
+
+    std::set<uint64_t> frames;
+    if(golden) frames = golden->frames(j);
+
+    // hash the screen, record or compare it
+    auto checkpoint = [&](const std::string &name){
+        uint64_t hash = c8.get_screen_hash();
+        result.checkpoints.emplace_back(name, hash);
+        if(!golden) return;
+
+        if(golden->update){
+            write_pbm(golden->image(j, name, false), c8);
+            return;
+        }
+
+        auto expected = golden->hashes.find(golden_file::key(j, name));
+        if(expected == golden->hashes.end()){
+            if(result.golden.empty()) result.golden = "no golden hash at " + name;
+        }else if(expected->second != hash){
+            write_pbm(golden->image(j, name, true), c8);
+            if(result.golden.empty()) result.golden = "mismatch at " + name;
+        }
+    };
+
+    // without a seed the runs must still be reproducible
+    chip8::input_recording recording;
+    if(!j.input.empty()){
+        auto header = recording.replay(j.input);
+        if(header.mode_hash != mode.hash){
+            throw std::runtime_error("input recording is from another mode");
+        }
+        c8.set_seed(header.seed);
+    }else{
+        c8.set_seed(mode.config.seed ? mode.config.seed : 1);
+    }
+
+    if(c8.load_binary(j.rom)){
+        throw std::runtime_error("couldn't open " + j.rom.string());
+    }
+
+    frontend_headless f(c8.get_screen_x(), c8.get_screen_y(), 1, 60);
+    chip8::input_log<chip8_class> input(c8, recording);
+
+    unsigned int cycles;
+    unsigned int frame_cycles = 0;
+    uint64_t frame = 0;
+    result.status = "running";
+    try{
+        input.get_keys(f);
+        while(result.cycles < j.cycles){
+            int running = c8.step(f, cycles, std::min<uint64_t>(c8.get_cycles_per_frame() - frame_cycles, j.cycles - result.cycles));
+            result.cycles += cycles;
+            if(!running){
+                result.status = "stopped";
+                break;
+            }
+
+            // frames only matter for input and frame driven timers, like in chip8 --turbo
+            frame_cycles += cycles;
+            if(frame_cycles >= c8.get_cycles_per_frame()){
+                frame_cycles = 0;
+                c8.end_frame(f);
+                frame++;
+                if(frames.count(frame)) checkpoint(std::to_string(frame));
+                input.get_keys(f);
+            }
+        }
+        c8.flush_outputs();
+    }catch(std::exception &e){
+        result.status = "error";
+        result.error = e.what();
+    }
+
+    result.opcode = c8.get_previous_opcode();
+    result.screen_hash = c8.get_screen_hash();
+    checkpoint("end");
+
+    if(golden && !golden->update && result.golden.empty()){
+        // a frame the run didn't reach
+        result.golden = !frames.empty() && *frames.rbegin() > frame ? "not reached " + std::to_string(*frames.rbegin()) : "ok";
+    }
+    return result;
+}
+
+int main(int argc, char* argv[]){
+    unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+    bool use_mode_cache = true;
+    std::unique_ptr<golden_file> golden;
+    std::string frames;
+    std::vector<char*> arguments;
+
+    for(int i = 1; i < argc; i++){
+        std::string argument = argv[i];
+        if(argument == "--threads" && i + 1 < argc){
+            threads = std::max(1ul, std::strtoul(argv[++i], nullptr, 10));
+        }else if(argument == "--no-mode-cache"){
+            use_mode_cache = false;
+        }else if((argument == "--golden" || argument == "--update-golden") && i + 1 < argc){
+            golden = std::make_unique<golden_file>();
+            golden->filename = argv[++i];
+            golden->update = argument == "--update-golden";
+        }else if(argument == "--frames" && i + 1 < argc){
+            frames = argv[++i];
+        }else{
+            arguments.push_back(argv[i]);
+        }
+    }
+
+    if(arguments.size() != 1){
+        std::cerr << "usage: " << argv[0] << " [--threads n] [--no-mode-cache] [--golden file | --update-golden file [--frames n,...]] manifest\n";
+        return 1;
+    }
+    if(!frames.empty() && !(golden && golden->update)){
+        std::cerr << "--frames needs --update-golden, a comparison uses the frames of the golden file\n";
+        return 1;
+    }
+
+    std::vector<job> jobs;
+    std::map<std::filesystem::path, batch_mode> modes;
+    try{
+        jobs = read_manifest(arguments.at(0));
+
+        // Lua is only used here and by modes with callbacks
+        chip8::mode_cache cache(use_mode_cache ? chip8::mode_cache::default_directory() : std::filesystem::path());
+        for(const job &j : jobs){
+            if(modes.count(j.mode)) continue;
+
+            batch_mode &mode = modes[j.mode];
+            try{
+                if(!cache.load(j.mode, mode.config)){
+                    lua_State *L = chip8::load_mode(j.mode);
+                    mode.config = chip8::mode_config(L);
+                    if(!mode.config.callbacks) cache.store(j.mode, chip8::mode_dependencies(L), mode.config);
+                    lua_close(L);
+                }
+                mode.hash = mode.config.hash();
+
+                // results must not depend on the host clock
+                if(mode.config.timers != "cycles" && mode.config.timers != "frames") mode.config.timers = "cycles";
+            }catch(std::runtime_error &e){
+                mode.error = e.what();
+            }
+        }
+
+        if(golden){
+            std::istringstream list(frames);
+            std::string frame;
+            while(std::getline(list, frame, ',')){
+                golden->update_frames.insert(std::strtoull(frame.c_str(), nullptr, 10));
+            }
+
+            if(!golden->update) golden->read();
+
+            // images of earlier runs would be mistaken for results of this one
+            std::filesystem::path images = golden->filename.string() + (golden->update ? ".frames" : ".actual");
+            std::filesystem::remove_all(images);
+            std::filesystem::create_directories(images);
+        }
+    }catch(std::exception &e){
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    // a job that is listed twice runs once, its runs would give the same results and write the same images
+    std::vector<size_t> unique_jobs, first_listed(jobs.size());
+    std::map<std::string, size_t> listed;
+    for(size_t i = 0; i < jobs.size(); i++){
+        auto [entry, added] = listed.emplace(jobs[i].name, i);
+        if(added) unique_jobs.push_back(i);
+        first_listed[i] = entry->second;
+    }
+
+    threads = std::min<size_t>(threads, std::max<size_t>(unique_jobs.size(), 1));
+    std::vector<job_result> results(jobs.size());
+    std::vector<std::map<std::filesystem::path, interpreter_instance>> instances(threads);
+
+    job_pool::run(unique_jobs.size(), threads, [&](unsigned int thread, size_t unique_index){
+        size_t index = unique_jobs[unique_index];
+        const job &j = jobs[index];
+        const batch_mode &mode = modes.at(j.mode);
+        job_result &result = results[index];
+
+        try{
+            if(!mode.error.empty()){
+                throw std::runtime_error(mode.error);
+            }
+
+            interpreter_instance &instance = instances[thread][j.mode];
+            if(!instance.c8){
+                if(mode.config.callbacks && !instance.L){
+                    instance.L = chip8::load_mode(j.mode);
+                    // stdout is for the results
+                    luaL_dostring(instance.L,
+                        "print = function(...) "
+                        "local t = table.pack(...) "
+                        "for i = 1, t.n do t[i] = tostring(t[i]) end "
+                        "io.stderr:write(table.concat(t, '\\t'), '\\n') "
+                        "end");
+                }
+                instance.c8 = std::make_unique<chip8_class>(mode.config, instance.L);
+            }
+            result = run_job(j, mode, *instance.c8, golden.get());
+        }catch(std::exception &e){
+            result.error = e.what();
+        }
+    });
+    instances.clear();
+    for(size_t i = 0; i < jobs.size(); i++){
+        if(first_listed[i] != i) results[i] = results[first_listed[i]];
+    }
+
+    size_t golden_failures = 0;
+    if(golden && !golden->update){
+        for(job_result &result : results){
+            if(result.golden.empty()) result.golden = "not run";
+            if(result.golden != "ok") golden_failures++;
+        }
+    }
+
+    std::cout << "rom,mode,status,opcode,cycles,screen_hash,golden,error\n";
+    for(size_t i = 0; i < jobs.size(); i++){
+        const job_result &result = results[i];
+        std::string error = result.error;
+        // the error message must not break the CSV format
+        std::replace(error.begin(), error.end(), ',', ';');
+        std::replace(error.begin(), error.end(), '\n', ' ');
+
+        std::cout
+        << jobs[i].rom.string() << ","
+        << jobs[i].mode.string() << ","
+        << result.status << ","
+        << std::hex << std::setw(4) << std::setfill('0') << result.opcode << std::dec << ","
+        << result.cycles << ","
+        << std::hex << std::setw(16) << result.screen_hash << std::dec << std::setfill(' ') << ","
+        << result.golden << ","
+        << error << "\n";
+    }
+
+    if(golden && golden->update){
+        try{
+            golden->write(jobs, results);
+        }catch(std::runtime_error &e){
+            std::cerr << e.what() << "\n";
+            return 1;
+        }
+    }
+    if(golden_failures){
+        std::cerr << golden_failures << " of " << jobs.size() << " jobs differ from " << golden->filename.string()
+        << ", their screens are in " << golden->filename.string() << ".actual\n";
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,188 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "interpreter.cpp"
+#include "audio.cpp"
+#include "frontend_headless.cpp"
+
+extern "C"
+{
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+}
+
+/** Throughput benchmark.
+Runs a set of synthetic programs in every mode and prints the results as CSV.
+*/
+
+/// a synthetic program, generated for a program start address
+struct benchmark_program{
+    std::string name;
+    std::vector<uint16_t> (*generate)(uint16_t start);
+};
+
+/// register arithmetic in a tight loop
+std::vector<uint16_t> program_alu(uint16_t start){
+    return {
+        0x6001, 0x6102, 0x6203,
+        // loop
+        0x8014, 0x8125, 0x8216, 0x8307, 0x840e, 0x8511, 0x8622, 0x8733, 0x7001, 0xa123,
+        static_cast<uint16_t>(0x1000 | (start + 6)),
+    };
+}
+
+/// random 8x5 and 8x15 sprites from the font
+std::vector<uint16_t> program_sprites(uint16_t start){
+    return {
+        0x00e0, 0xa000,
+        // loop
+        0xc03f, 0xc11f, 0xd015, 0xd01f, 0xc03f, 0xc11f, 0xd01a,
+        static_cast<uint16_t>(0x1000 | (start + 4)),
+    };
+}
+
+/// scrolling in every direction in high resolution mode (SUPER-CHIP)
+std::vector<uint16_t> program_scroll(uint16_t start){
+    return {
+        0x00ff, 0xa000, 0x6010, 0x6108, 0xd015,
+        // loop
+        0x00c1, 0x00fb, 0x00fc, 0x00fc, 0x00fb, 0xd015,
+        static_cast<uint16_t>(0x1000 | (start + 10)),
+    };
+}
+
+/// drawing on alternating planes (XO-CHIP)
+std::vector<uint16_t> program_planes(uint16_t start){
+    return {
+        0x00ff, 0xa000,
+        // loop
+        0xf101, 0xc07f, 0xc13f, 0xd015, 0xf201, 0xc07f, 0xc13f, 0xd015, 0xf301, 0x00d1, 0x00e0,
+        static_cast<uint16_t>(0x1000 | (start + 4)),
+    };
+}
+
+/// storing and loading all registers
+std::vector<uint16_t> program_memory(uint16_t start){
+    uint16_t data = start + 0x100;
+    return {
+        // loop
+        static_cast<uint16_t>(0xa000 | data), 0xff55,
+        static_cast<uint16_t>(0xa000 | data), 0xff65, 0x7001,
+        static_cast<uint16_t>(0xa000 | data), 0xf033,
+        static_cast<uint16_t>(0x1000 | start),
+    };
+}
+
+const std::vector<benchmark_program> programs = {
+    {"alu", program_alu},
+    {"sprites", program_sprites},
+    {"scroll", program_scroll},
+    {"planes", program_planes},
+    {"memory", program_memory},
+};
+
+/// run one program in one mode and print a CSV line
+void run_benchmark(const std::filesystem::path &mode, const benchmark_program &program, uint64_t instructions){
+    using chip8_class = chip8::chip8_interpreter<chip8::chip8_instruction_set, chip8::chip8_quirks, chip8::chip8_hardware<chip8::chip8_palette>>;
+
+    lua_State *L = chip8::load_mode(mode);
+    std::string error;
+    uint64_t executed = 0;
+    uint64_t sprites = 0;
+    uint64_t primitives = 0;
+    double seconds = 0;
+
+    try{
+        chip8_class c8(L);
+
+        std::vector<uint8_t> binary;
+        for(uint16_t opcode : program.generate(c8.get_program_start())){
+            binary.push_back(opcode >> 8);
+            binary.push_back(opcode & 0xff);
+        }
+        c8.load_program(binary);
+
+        frontend_headless f(c8.get_screen_x(), c8.get_screen_y(), 1, 60);
+        c8.frontend_init(f);
+
+        unsigned int cycles;
+        unsigned int frame_cycles = 0;
+        std::chrono::time_point<std::chrono::steady_clock> clock_start = std::chrono::steady_clock::now();
+        try{
+            while(executed < instructions){
+                int running = c8.step(f, cycles, std::min<uint64_t>(c8.get_cycles_per_frame() - frame_cycles, instructions - executed));
+                executed += cycles;
+                if(!running) break;
+
+                // the screen is drawn once per frame
+                frame_cycles += cycles;
+                if(frame_cycles >= c8.get_cycles_per_frame()){
+                    frame_cycles = 0;
+                    c8.present(f);
+                }
+            }
+            c8.present(f);
+        }catch(std::exception &e){
+            error = e.what();
+        }
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - clock_start).count();
+        sprites = c8.get_sprites_drawn();
+        primitives = f.get_draws();
+    }catch(std::exception &e){
+        error = e.what();
+    }
+    lua_close(L);
+
+    // the error message must not break the CSV format
+    std::replace(error.begin(), error.end(), ',', ';');
+
+    std::cout
+    << mode.stem().string() << ","
+    << program.name << ","
+    << executed << ","
+    << seconds << ","
+    << static_cast<uint64_t>(seconds > 0 ? executed / seconds : 0) << ","
+    << static_cast<uint64_t>(seconds > 0 ? sprites / seconds : 0) << ","
+    << static_cast<uint64_t>(seconds > 0 ? primitives / seconds : 0) << ","
+    << (executed ? seconds * 1e9 / executed : 0) << ","
+    << error << std::endl;
+}
+
+int main(int argc, char* argv[]){
+    if(argc < 2){
+        std::cerr << "usage: " << argv[0] << " modes_directory [instructions]\n";
+        return 1;
+    }
+
+    uint64_t instructions = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 200000;
+
+    std::vector<std::filesystem::path> modes;
+    for(const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(argv[1])){
+        if(entry.path().extension() == ".lua") modes.push_back(entry.path());
+    }
+    std::sort(modes.begin(), modes.end());
+
+    std::cout << "mode,program,instructions,seconds,instructions_per_second,sprites_per_second,frontend_primitives_per_second,ns_per_instruction,error" << std::endl;
+
+    try{
+        for(const std::filesystem::path &mode : modes){
+            for(const benchmark_program &program : programs){
+                run_benchmark(mode, program, instructions);
+            }
+        }
+    }catch(std::runtime_error &e){
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    return 0;
+}
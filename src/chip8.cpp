@@ -5,15 +5,27 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
+#include <span>
 #include <stack>
 #include <stdexcept>
 #include <string>
 #include <thread>
 #include <cstring>
 #include <filesystem>
+#include <vector>
 
 #include "interpreter.cpp"
+#include "scheduler.cpp"
+#include "audio.cpp"
+#ifdef CHIP8_NOTCURSES
+#include "frontend_notcurses.cpp"
+#else
 #include "frontend_sdl.cpp"
+#endif
+#include "frontend_headless.cpp"
+#include "rewind.cpp"
+#include "input.cpp"
 
 extern "C"
 {
@@ -22,63 +34,270 @@ extern "C"
 #include <lualib.h>
 }
 
-template<class chip8_class, class frontend_class> void run(char* filename, lua_State* L){
+/// command line options
+struct options{
+    /// use the headless frontend instead of SDL
+    bool headless = false;
+    /// run uncapped for this many instructions, 0 runs in real time
+    uint64_t turbo_instructions = 0;
+    /// write the audio of a headless run into this WAV file
+    std::string wav_filename;
+    /// read modes from and store them in the mode cache
+    bool mode_cache = true;
+    /// start from this save state
+    std::string load_state_filename;
+    /// write a save state when the run ends
+    std::string save_state_filename;
+    /// bytes of rewind history, 0 disables rewinding
+    size_t rewind_budget = 0;
+    /// seed of the random numbers, 0 uses the one of the mode
+    uint64_t seed = 0;
+    /// record the key input into this file
+    std::string record_filename;
+    /// replay the key input of this file instead of reading the keyboard
+    std::string replay_filename;
+};
 
-    lua_getfield(L, -1, "frametime");
-    int frametime = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : 1000;
-    lua_pop(L, 1);
+/// run at the speed of the mode, one frame at 60 Hz
+template<class chip8_class, class frontend_class> void run_realtime(chip8_class &c8, frontend_class &f, chip8::input_log<chip8_class> &input, size_t rewind_budget){
+    unsigned int cycles;
+    bool running = true;
+    unsigned int cycles_per_frame = c8.get_cycles_per_frame();
 
-    using namespace std::chrono_literals;
-    std::chrono::time_point<std::chrono::steady_clock> clock_start;
+    chip8::frame_scheduler scheduler(std::chrono::microseconds(1000000 / 60));
 
-    chip8_class c8(L);
+    // the machine after every frame, for stepping back while the frontend asks to rewind
+    chip8::rewind_buffer rewind(rewind_budget);
+    std::vector<uint8_t> snapshot, header;
+    // the buffer reads the machine in place and only keeps the changes
+    auto push_frame = [&]{
+        std::span<const uint8_t> state = c8.save_state_view(header);
+        rewind.push(header, state);
+    };
+    if(rewind_budget) push_frame();
+
+    while(running){
+        // handle input
+        f.poll_event();
+        if(f.get_quit_requested()) break;
+        input.get_keys(f);
+
+        bool rewinding = false;
+        if constexpr(requires{ f.get_rewind_requested(); }){
+            rewinding = rewind_budget && f.get_rewind_requested();
+        }
+
+        if(rewinding){
+            // one frame back per frame, the oldest frame stays on screen
+            if(rewind.step_back(snapshot)) c8.load_state(f, snapshot);
+        }else{
+            // execute one frame worth of opcodes or basic blocks
+            for(unsigned int frame_cycles = 0; frame_cycles < cycles_per_frame; frame_cycles += cycles){
+                if(!c8.step(f, cycles, cycles_per_frame - frame_cycles)){
+                    running = false;
+                    break;
+                }
+            }
+
+            c8.end_frame(f);
+
+            if(rewind_budget) push_frame();
+        }
+
+        // update the screen
+        c8.present(f);
+        f.refresh();
+
+        // wait for the next frame
+        scheduler.wait();
+    }
+
+    std::cout << "\nframe pacing:\n";
+    scheduler.print(std::cout);
+}
+
+/// run as fast as possible for a number of instructions or until the program stops and print the speed
+template<class chip8_class, class frontend_class> void run_turbo(chip8_class &c8, frontend_class &f, chip8::input_log<chip8_class> &input, uint64_t instructions){
+    unsigned int cycles;
+    unsigned int frame_cycles = 0;
+    uint64_t executed = 0;
+
+    std::chrono::time_point<std::chrono::steady_clock> clock_start = std::chrono::steady_clock::now();
+
+    // the keys of the first frame, like run_realtime()
+    f.poll_event();
+    input.get_keys(f);
+
+    while(executed < instructions){
+        int running = c8.step(f, cycles, std::min<uint64_t>(c8.get_cycles_per_frame() - frame_cycles, instructions - executed));
+        executed += cycles;
+        if(!running) break;
+
+        // frames only matter for input and frame driven timers
+        frame_cycles += cycles;
+        if(frame_cycles >= c8.get_cycles_per_frame()){
+            frame_cycles = 0;
+            f.poll_event();
+            if(f.get_quit_requested()) break;
+            c8.end_frame(f);
+            input.get_keys(f);
+            c8.present(f);
+            f.refresh();
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - clock_start).count();
+
+    std::cout
+    << "\ninstructions                    " << executed << "\n"
+    << "time                            " << seconds << " s\n"
+    << "instructions per second         " << static_cast<uint64_t>(seconds > 0 ? executed / seconds : 0) << "\n";
+}
+
+template<class chip8_class, class frontend_class> void run(char* filename, const chip8::mode_config &mode, lua_State* L, const options &opts){
+
+    chip8_class c8(mode, L);
 
     if(c8.load_binary(filename)){
         throw std::runtime_error(std::string("couldn't open ") + filename);
     }
 
     frontend_class f(c8.get_screen_x(), c8.get_screen_y(), 10, 60);
+    if constexpr(requires{ f.write_wav(opts.wav_filename); }){
+        if(!opts.wav_filename.empty()) f.write_wav(opts.wav_filename);
+    }
     c8.frontend_init(f);
+
+    // a replay brings its seed, a recording stores the seed in use
+    chip8::input_recording recording;
+    if(!opts.replay_filename.empty()){
+        auto header = recording.replay(opts.replay_filename);
+        if(header.mode_hash != mode.hash()){
+            throw std::runtime_error("input recording is from another mode");
+        }
+        c8.set_seed(header.seed);
+    }else if(opts.seed){
+        c8.set_seed(opts.seed);
+    }
+    if(!opts.record_filename.empty()){
+        recording.record(opts.record_filename, mode.hash(), c8.get_seed());
+    }
+    chip8::input_log<chip8_class> input(c8, recording);
+
+    if(!opts.load_state_filename.empty()){
+        std::ifstream file(opts.load_state_filename, std::ios::binary);
+        if(!file){
+            throw std::runtime_error("couldn't open " + opts.load_state_filename);
+        }
+        c8.load_state(f, std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>()));
+    }
     c8.print(std::cout);
 
-    while(1){
-        clock_start = std::chrono::steady_clock::now();
-        
-        // handle input
-        f.poll_event();
-        if(f.get_quit_requested()) break;
-        f.get_keys(c8);
-        
-        // execute one opcode
-        if(!c8.execute(f)) break;
-        
-        // update the screen
-        f.refresh();
+    if(opts.turbo_instructions){
+        run_turbo(c8, f, input, opts.turbo_instructions);
+    }else{
+        run_realtime(c8, f, input, opts.rewind_budget);
+    }
+    c8.flush_outputs();
+
+    if(!opts.save_state_filename.empty()){
+        std::vector<uint8_t> state;
+        c8.save_state(state);
+        std::ofstream file(opts.save_state_filename, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(state.data()), state.size());
+        if(!file){
+            throw std::runtime_error("couldn't write " + opts.save_state_filename);
+        }
+    }
 
-        // wait
-        std::this_thread::sleep_until(clock_start + frametime * 1us);
+    if constexpr(requires{ f.print(std::cout); }){
+        std::cout << "\nfrontend:\n";
+        f.print(std::cout);
+    }
+}
+
+/// run the first specialization that matches the mode, or the generic interpreter if none does
+template<class frontend_class, class... specializations> void run_specialized(char* filename, const chip8::mode_config &mode, lua_State* L, const options &opts){
+    bool matched = ((specializations::matches(mode.instruction_set_flags, mode.quirk_flags) && (run<typename specializations::interpreter, frontend_class>(filename, mode, L, opts), true)) || ...);
+
+    if(!matched){
+        run<chip8::chip8_interpreter<chip8::chip8_instruction_set, chip8::chip8_quirks, chip8::chip8_hardware<chip8::chip8_palette>>, frontend_class>(filename, mode, L, opts);
+    }
+}
+
+/// run with the frontend selected by the options
+template<class... specializations> void run_frontend(std::tuple<specializations...>, char* filename, const chip8::mode_config &mode, lua_State* L, const options &opts){
+    if(opts.headless){
+        run_specialized<frontend_headless, specializations...>(filename, mode, L, opts);
+    }else{
+        run_specialized<frontend_sdl, specializations...>(filename, mode, L, opts);
     }
 }
 
 int main(int argc, char* argv[]){
-    if(argc < 3){
-        std::cerr << "usage: " << argv[0] << " mode file\n";
+    options opts;
+    std::vector<char*> arguments;
+
+    for(int i = 1; i < argc; i++){
+        std::string argument = argv[i];
+        if(argument == "--headless"){
+            opts.headless = true;
+        }else if(argument == "--turbo" && i + 1 < argc){
+            opts.turbo_instructions = std::strtoull(argv[++i], nullptr, 10);
+        }else if(argument == "--wav" && i + 1 < argc){
+            opts.wav_filename = argv[++i];
+        }else if(argument == "--no-mode-cache"){
+            opts.mode_cache = false;
+        }else if(argument == "--load-state" && i + 1 < argc){
+            opts.load_state_filename = argv[++i];
+        }else if(argument == "--save-state" && i + 1 < argc){
+            opts.save_state_filename = argv[++i];
+        }else if(argument == "--rewind" && i + 1 < argc){
+            opts.rewind_budget = std::strtoull(argv[++i], nullptr, 10) << 20;
+        }else if(argument == "--seed" && i + 1 < argc){
+            opts.seed = std::strtoull(argv[++i], nullptr, 10);
+        }else if(argument == "--record" && i + 1 < argc){
+            opts.record_filename = argv[++i];
+        }else if(argument == "--replay" && i + 1 < argc){
+            opts.replay_filename = argv[++i];
+        }else{
+            arguments.push_back(argv[i]);
+        }
+    }
+
+    if(arguments.size() < 2){
+        std::cerr << "usage: " << argv[0] << " [--headless] [--turbo instructions] [--wav file] [--no-mode-cache] [--load-state file] [--save-state file] [--rewind MiB] [--seed n] [--record file] [--replay file] mode file\n";
+        return 1;
+    }
+    if(!opts.wav_filename.empty() && !opts.headless){
+        std::cerr << "--wav needs --headless\n";
+        return 1;
+    }
+    if(opts.rewind_budget && (!opts.record_filename.empty() || !opts.replay_filename.empty())){
+        std::cerr << "--rewind can't be combined with --record or --replay\n";
         return 1;
     }
 
     try{
-        lua_State *L = luaL_newstate();
-        luaL_openlibs(L);
-        luaL_dostring(L, ("package.path = package.path .. ';" + std::filesystem::path(argv[1]).parent_path().string() + "/?.lua'").c_str());
+        std::filesystem::path mode_file = arguments.at(0);
+        chip8::mode_config mode;
+        lua_State *L = nullptr;
 
-        if(!luaL_dofile(L, argv[1]) == LUA_OK){
-            throw std::runtime_error(lua_tostring(L, -1));
-        }
-        if(!lua_istable(L, -1)){
-            throw std::runtime_error(argv[1] + std::string(" did not return a table"));
+        // only modes with callbacks need Lua once they are cached
+        chip8::mode_cache cache(opts.mode_cache ? chip8::mode_cache::default_directory() : std::filesystem::path());
+        if(!cache.load(mode_file, mode)){
+            L = chip8::load_mode(mode_file);
+            mode = chip8::mode_config(L);
+            if(!mode.callbacks){
+                cache.store(mode_file, chip8::mode_dependencies(L), mode);
+                lua_close(L);
+                L = nullptr;
+            }
         }
 
-        run<chip8::chip8_interpreter<chip8::chip8_instruction_set, chip8::chip8_quirks, chip8::chip8_hardware<chip8::chip8_palette>>, frontend_sdl>(argv[2], L);
+        run_frontend(chip8::specializations{}, arguments.at(1), mode, L, opts);
+
+        if(L) lua_close(L);
 
     }catch(std::runtime_error &e){
         std::cerr << e.what() << "\n";
@@ -0,0 +1,32 @@
+#include <array>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+
+namespace chip8{
+    /** The interface between the interpreter and a frontend.
+    The interpreter only draws with whole rectangles, rows and images, so a frontend can
+    turn every emulated screen operation into one operation of its backend.
+    */
+    template<class frontend> concept chip8_frontend = requires(frontend f, std::array<uint8_t, 3> c, const std::array<uint8_t, 3> *colors, const std::array<uint8_t, 16> &pattern, bool b){
+        /// fill width x height pixels at x, y with a color
+        f.fill_rect(0, 0, 1, 1, c);
+        /// draw width pixels of a row, starting at x, y
+        f.blit_row(0, 0, 1, colors);
+        /// move the image by dx, dy pixels and fill the uncovered area with a color
+        f.scroll(0, 0, c);
+        /// fill the whole image with a color
+        f.clear(c);
+        /// show the image
+        f.refresh();
+        /// ignore drawing while the emulated display is off
+        f.set_draw_disabled(b);
+
+        f.set_audio_frequency(0.0);
+        f.set_audio_pattern(pattern);
+        f.set_audio_state(b);
+
+        f.poll_event();
+        { f.get_quit_requested() } -> std::convertible_to<bool>;
+    };
+}
@@ -0,0 +1,143 @@
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/** A frontend without display, audio device or input.
+It counts the calls of the interpreter, e.g. for benchmarks and machines without a display.
+The audio is rendered from the emulated time, so it is the same on every run and can be written to a WAV file.
+*/
+class frontend_headless{
+    protected:
+        int screen_width, screen_height;
+        bool draw_disabled = false;
+
+        // call counters
+        uint64_t fills = 0, blits = 0, pixels = 0, clears = 0, scrolls = 0, refreshes = 0, audio_changes = 0;
+
+        // audio
+        static constexpr int audio_sample_rate = 4096 * 8;
+        chip8::audio_engine audio;
+        std::vector<uint8_t> audio_buffer;
+        uint64_t audio_samples = 0;
+        /// FNV-1a hash of all samples
+        uint64_t audio_hash = 0xcbf29ce484222325;
+        std::unique_ptr<chip8::wav_writer> wav;
+
+    public:
+        frontend_headless(int render_width, int render_height, int scale, int refresh_rate) :
+            audio(audio_sample_rate, refresh_rate, 0){
+            (void)scale;
+            // refresh() renders every frame in this thread, so no change has to wait in the queue
+            audio.set_synchronous(true);
+            screen_width = render_width;
+            screen_height = render_height;
+        }
+
+        /// write the audio into a WAV file
+        void write_wav(const std::string &filename){
+            wav = std::make_unique<chip8::wav_writer>(filename, audio_sample_rate);
+        }
+
+        void set_audio_frequency(double frequency){
+            audio.set_frequency(frequency);
+            audio_changes++;
+        }
+
+        void set_audio_pattern(const std::array<uint8_t, 16> &pattern){
+            audio.set_pattern(pattern);
+            audio_changes++;
+        }
+
+        void set_audio_state(bool playing){
+            audio.set_gate(playing);
+            audio_changes++;
+        }
+
+        void poll_event(){
+        }
+
+        bool get_quit_requested(){
+            return false;
+        }
+
+        void set_draw_disabled(bool disabled){
+            draw_disabled = disabled;
+        }
+
+        template<class chip8> void get_keys(chip8 &c8){
+            (void)c8;
+        }
+
+        void fill_rect(int x, int y, int width, int height, std::array<uint8_t, 3> color){
+            (void)x;
+            (void)y;
+            (void)color;
+            if(draw_disabled) return;
+
+            fills++;
+            pixels += width * height;
+        }
+
+        void blit_row(int x, int y, int width, const std::array<uint8_t, 3> *colors){
+            (void)x;
+            (void)y;
+            (void)colors;
+            if(draw_disabled) return;
+
+            blits++;
+            pixels += width;
+        }
+
+        void clear(std::array<uint8_t, 3> color){
+            (void)color;
+            if(draw_disabled) return;
+
+            clears++;
+        }
+
+        void scroll(int dx, int dy, std::array<uint8_t, 3> color){
+            (void)dx;
+            (void)dy;
+            (void)color;
+            if(draw_disabled) return;
+
+            scrolls++;
+        }
+
+        /// called once per emulated frame, renders the audio of the frame
+        void refresh(){
+            refreshes++;
+
+            audio.end_frame();
+            audio_buffer.resize(audio.get_time() - audio_samples);
+            audio.render(audio_buffer.data(), audio_buffer.size());
+            audio_samples += audio_buffer.size();
+
+            for(uint8_t sample : audio_buffer){
+                audio_hash = (audio_hash ^ sample) * 0x100000001b3;
+            }
+            if(wav) wav->write(audio_buffer.data(), audio_buffer.size());
+        }
+
+        /// number of drawing operations, not counting clears and scrolls
+        uint64_t get_draws(){
+            return fills + blits;
+        }
+
+        /// Print the call counters to outstream
+        void print(std::ostream &outstream){
+            outstream
+            << "rectangles filled               " << fills << "\n"
+            << "rows drawn                      " << blits << "\n"
+            << "pixels drawn                    " << pixels << "\n"
+            << "screen clears                   " << clears << "\n"
+            << "screen scrolls                  " << scrolls << "\n"
+            << "refreshes                       " << refreshes << "\n"
+            << "audio changes                   " << audio_changes << "\n"
+            << "audio samples                   " << audio_samples << "\n"
+            << "audio hash                      " << std::hex << audio_hash << std::dec << "\n";
+        }
+};
@@ -1,3 +1,8 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <vector>
 #include <exception>
 #include <stdexcept>
@@ -6,7 +11,13 @@
 
 class frontend_sdl{
     protected:
-        unsigned int screen_width, screen_height;
+        int render_width, render_height;
+        bool draw_disabled = false;
+
+        /// the image as RGBA, blitted into the plane on refresh
+        std::vector<uint32_t> pixels;
+        /// pixel rows changed since the last refresh, none if first_changed_row > last_changed_row
+        int first_changed_row, last_changed_row;
 
     private:
         struct notcurses* nc;
@@ -14,13 +25,20 @@ class frontend_sdl{
         struct ncplane* nc_std;
         int last_key, last_kb;
 
+        /// the blitter and the pixels it packs into one cell
+        ncblitter_e blitter;
+        int cell_width, cell_height;
+
     public:
         frontend_sdl(int render_width, int render_height, int scale, int refresh_rate){
             (void)scale;
             (void)refresh_rate;
 
-            screen_width = render_width * 2;
-            screen_height = render_height;
+            this->render_width = render_width;
+            this->render_height = render_height;
+            pixels.assign(render_width * render_height, rgba({0, 0, 0}));
+            first_changed_row = 0;
+            last_changed_row = render_height - 1;
 
             last_key = -1;
             last_kb = -1;
@@ -38,14 +56,33 @@ class frontend_sdl{
                 throw std::runtime_error("notcurses_init failed");
             }
 
+            // pack as many pixels into a cell as the terminal can show
+            if(notcurses_cansextant(nc)){
+                blitter = NCBLIT_3x2;
+                cell_width = 2;
+                cell_height = 3;
+            }else if(notcurses_canquadrant(nc)){
+                blitter = NCBLIT_2x2;
+                cell_width = 2;
+                cell_height = 2;
+            }else if(notcurses_canhalfblock(nc)){
+                blitter = NCBLIT_2x1;
+                cell_width = 1;
+                cell_height = 2;
+            }else{
+                blitter = NCBLIT_1x1;
+                cell_width = 1;
+                cell_height = 1;
+            }
+
             // create plane
             unsigned int x, y;
             nc_std = notcurses_stddim_yx(nc, &y, &x);
             struct ncplane_options plane_opts = {
                 .y = NCALIGN_CENTER,
                 .x = NCALIGN_CENTER,
-                .rows = screen_height,
-                .cols = screen_width,
+                .rows = static_cast<unsigned int>((render_height + cell_height - 1) / cell_height),
+                .cols = static_cast<unsigned int>((render_width + cell_width - 1) / cell_width),
                 .userptr = nullptr,
                 .name = "chip8",
                 .resizecb = nullptr,
@@ -66,9 +103,8 @@ class frontend_sdl{
             (void)frequency;
         }
 
-        void set_audio_pattern(size_t i, uint8_t p){
-            (void)i;
-            (void)p;
+        void set_audio_pattern(const std::array<uint8_t, 16> &pattern){
+            (void)pattern;
         }
 
         void set_audio_state(bool playing){
@@ -82,20 +118,38 @@ class frontend_sdl{
             return false;
         }
 
+        void set_draw_disabled(bool disabled){
+            draw_disabled = disabled;
+        }
+
+        /**
+         * @brief pass all pending key events to c8 without waiting for input
+         *
+         * Terminals that report event types send a release for every press.
+         * Keys of other terminals arrive without a type, they are released again in the next frame.
+         */
         template<class chip8> void get_keys(chip8 &c8){
             if(last_kb > 0 && last_key >= 0){
                 c8.set_key(last_kb, last_key, false);
+                last_kb = -1;
+                last_key = -1;
             }
 
             ncinput nc_input;
+            uint32_t event;
+            while((event = notcurses_get_nblock(nc, &nc_input)) != 0 && event != static_cast<uint32_t>(-1)){
+                handle_key(c8, event, nc_input.evtype);
+            }
+        }
+
+        /// map a notcurses key event to a key of c8
+        template<class chip8> void handle_key(chip8 &c8, uint32_t event, int evtype){
             bool pressed, set_last = false;
             int key = -1, kb = 1;
 
-            uint32_t event = notcurses_get(nc, nullptr, &nc_input);
-            
-            if(nc_input.evtype == NCTYPE_PRESS || nc_input.evtype == NCTYPE_REPEAT){
+            if(evtype == NCTYPE_PRESS || evtype == NCTYPE_REPEAT){
                 pressed = true;
-            }else if(nc_input.evtype == NCTYPE_RELEASE){
+            }else if(evtype == NCTYPE_RELEASE){
                 pressed = false;
             }else{
                 pressed = true;
@@ -152,22 +206,96 @@ class frontend_sdl{
             }
         }
 
-        void draw(int x, int y, std::array<uint8_t, 3> color){
-            ncplane_set_bg_rgb8(nc_plane, color.at(0), color.at(1), color.at(2));
-            ncplane_putchar_yx(nc_plane, y, x * 2, ' ');
-            ncplane_putchar_yx(nc_plane, y, x * 2 + 1, ' ');
+        /// RGBA value of a color in memory order
+        static uint32_t rgba(const std::array<uint8_t, 3> &color){
+            const uint8_t bytes[4] = {color[0], color[1], color[2], 0xff};
+            uint32_t value;
+            std::memcpy(&value, bytes, sizeof(value));
+            return value;
+        }
+
+        /// remember that the rows first to last have to be blitted again
+        void mark_rows(int first, int last){
+            first_changed_row = std::min(first_changed_row, first);
+            last_changed_row = std::max(last_changed_row, last);
+        }
+
+        void fill_rect(int x, int y, int width, int height, std::array<uint8_t, 3> color){
+            if(draw_disabled) return;
+
+            uint32_t value = rgba(color);
+            for(int row = y; row < y + height; row++){
+                std::fill_n(&pixels[row * render_width + x], width, value);
+            }
+            mark_rows(y, y + height - 1);
+        }
+
+        void blit_row(int x, int y, int width, const std::array<uint8_t, 3> *colors){
+            if(draw_disabled) return;
+
+            std::transform(colors, colors + width, &pixels[y * render_width + x], rgba);
+            mark_rows(y, y);
         }
 
         void clear(std::array<uint8_t, 3> color){
-            ncplane_set_bg_rgb8(nc_plane, color.at(0), color.at(1), color.at(2));
-            for(unsigned int y = 0; y < screen_height; y++){
-                for(unsigned int x = 0; x < screen_width; x++){
-                    ncplane_putchar_yx(nc_plane, y, x, ' ');
+            fill_rect(0, 0, render_width, render_height, color);
+        }
+
+        /// move the image by dx, dy pixels and fill the uncovered area with color
+        void scroll(int dx, int dy, std::array<uint8_t, 3> color){
+            if(draw_disabled) return;
+
+            uint32_t background = rgba(color);
+            int width = render_width - std::abs(dx);
+
+            // rows are copied in the direction that doesn't overwrite unread ones
+            for(int i = 0; i < render_height; i++){
+                int y = dy > 0 ? render_height - 1 - i : i;
+                uint32_t *row = &pixels[y * render_width];
+                int source_y = y - dy;
+
+                if(source_y < 0 || source_y >= render_height || width <= 0){
+                    std::fill(row, row + render_width, background);
+                    continue;
+                }
+
+                const uint32_t *source = &pixels[source_y * render_width];
+                if(dx >= 0){
+                    std::copy_backward(source, source + width, row + render_width);
+                    std::fill(row, row + dx, background);
+                }else{
+                    std::copy(source - dx, source + render_width, row);
+                    std::fill(row + width, row + render_width, background);
                 }
             }
+            mark_rows(0, render_height - 1);
         }
 
+        /**
+         * @brief blit the changed cell rows and render
+         *
+         * notcurses only writes the cells that differ from the last rendered frame,
+         * so an unchanged part of the screen costs no terminal output.
+         */
         void refresh(){
+            if(first_changed_row > last_changed_row) return;
+
+            // whole cells have to be blitted
+            int first = first_changed_row / cell_height * cell_height;
+            int last = std::min(render_height, (last_changed_row / cell_height + 1) * cell_height);
+
+            struct ncvisual_options vopts{};
+            vopts.n = nc_plane;
+            vopts.y = first / cell_height;
+            vopts.leny = last - first;
+            vopts.lenx = render_width;
+            vopts.blitter = blitter;
+            vopts.flags = NCVISUAL_OPTION_NODEGRADE;
+            ncblit_rgba(&pixels[first * render_width], render_width * sizeof(uint32_t), &vopts);
+
+            first_changed_row = render_height;
+            last_changed_row = -1;
+
             notcurses_render(nc);
         }
 };
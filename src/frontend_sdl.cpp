@@ -4,16 +4,21 @@
 #include <SDL2/SDL.h>
 #include <iostream>
 #include <cmath>
-
-double audio_offset = 0;
-std::array<uint8_t, 16> audio_pattern;
-double audio_frequency = 4000.0;
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <vector>
 
 class frontend_sdl{
     protected:
         int screen_width, screen_height, scale, frame_time;
+        int render_width, render_height;
         bool draw_disabled = false;
 
+        /// the image at the resolution of the emulated screen, uploaded once per refresh
+        std::vector<uint32_t> pixels;
+        bool pixels_changed = true;
+
     private:
         SDL_Window* sdl_window;
         SDL_Renderer* sdl_renderer;
@@ -25,12 +30,20 @@ class frontend_sdl{
         Uint64 time_to_refresh = 0;
         const Uint8 *keys;
 
+        static constexpr int audio_sample_rate = 4096 * 8;
+        static constexpr int audio_buffer_samples = 1024;
+        chip8::audio_engine audio;
+
     public:
-        frontend_sdl(int render_width, int render_height, int scale, int refresh_rate){
+        frontend_sdl(int render_width, int render_height, int scale, int refresh_rate) :
+            audio(audio_sample_rate, refresh_rate, audio_buffer_samples){
             this->scale = scale * 2;
             screen_width = render_width * this->scale;
             screen_height = render_height * this->scale;
             frame_time = 1000 / refresh_rate;
+            this->render_width = render_width;
+            this->render_height = render_height;
+            pixels.assign(render_width * render_height, 0);
 
             // initialize SDL
             if(SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0){
@@ -45,8 +58,11 @@ class frontend_sdl{
                 throw std::runtime_error(error);
             }
 
-            // create renderer
+            // create renderer, fall back to the software renderer on machines without a GPU
             sdl_renderer = SDL_CreateRenderer(sdl_window, -1, SDL_RENDERER_ACCELERATED);
+            if(sdl_renderer == nullptr){
+                sdl_renderer = SDL_CreateRenderer(sdl_window, -1, SDL_RENDERER_SOFTWARE);
+            }
             if(sdl_renderer == nullptr){
                 std::string error = SDL_GetError();
                 SDL_DestroyWindow(sdl_window);
@@ -54,8 +70,8 @@ class frontend_sdl{
                 throw std::runtime_error(error);
             }
 
-            // create texture
-            sdl_texture = SDL_CreateTexture(sdl_renderer, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_TARGET, screen_width, screen_height);
+            // create texture at the emulated resolution, the renderer scales it to the window
+            sdl_texture = SDL_CreateTexture(sdl_renderer, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STREAMING, render_width, render_height);
             if(sdl_texture == nullptr){
                 std::string error = SDL_GetError();
                 SDL_DestroyRenderer(sdl_renderer);
@@ -77,11 +93,12 @@ class frontend_sdl{
 
             // open audio device
             SDL_zero(sdl_audio_spec);
-            sdl_audio_spec.freq = (4096*8);
+            sdl_audio_spec.freq = audio_sample_rate;
             sdl_audio_spec.format = AUDIO_U8;
             sdl_audio_spec.channels = 1;
-            sdl_audio_spec.samples = 1024;
+            sdl_audio_spec.samples = audio_buffer_samples;
             sdl_audio_spec.callback = this->audio_callback;
+            sdl_audio_spec.userdata = &audio;
             sdl_audio_device_id = SDL_OpenAudioDevice(nullptr, 0, &sdl_audio_spec, nullptr, 0);
             if(sdl_audio_device_id == 0){
                 std::string error = SDL_GetError();
@@ -91,18 +108,20 @@ class frontend_sdl{
                 SDL_Quit();
                 throw std::runtime_error(error);
             }
-            audio_pattern.fill(0xf);
+
+            // the device plays all the time, the engine switches the sound on and off at the emulated tick
+            SDL_PauseAudioDevice(sdl_audio_device_id, 0);
 
             sdl_initialized = true;
 
             // clear window
-            SDL_SetRenderTarget(sdl_renderer, sdl_texture);
-            SDL_SetRenderDrawColor(sdl_renderer, 0x00, 0x00, 0x00, 0x00);
-            SDL_RenderClear(sdl_renderer);
             refresh();
         }
 
         ~frontend_sdl(){
+            if(audio.get_dropped_events()){
+                std::cerr << audio.get_dropped_events() << " audio changes were dropped because the audio queue was full\n";
+            }
             if(sdl_initialized){
                 SDL_CloseAudioDevice(sdl_audio_device_id);
                 SDL_DestroyTexture(sdl_texture);
@@ -113,25 +132,20 @@ class frontend_sdl{
         }
 
         static void audio_callback(void *userdata, uint8_t *stream, int len){
-            (void)userdata;
-            for(int i = 0; i < len; i++){
-                int offset = audio_offset;
-                stream[i] = (audio_pattern.at(offset >> 3) >> ((offset & 7) ^ 7)) & 1 ? 0x50 : 0x00;
-                audio_offset = fmod(audio_offset + (audio_frequency / (4096*8)), 128.0);
-            }
+            static_cast<chip8::audio_engine *>(userdata)->render(stream, len);
         }
 
-        static void set_audio_frequency(double frequency){
-            audio_frequency = frequency;
+        void set_audio_frequency(double frequency){
+            audio.set_frequency(frequency);
         }
 
-        static void set_audio_pattern(size_t i, uint8_t p){
-            audio_pattern.at(i) = p;
+        void set_audio_pattern(const std::array<uint8_t, 16> &pattern){
+            audio.set_pattern(pattern);
         }
 
         /// start or stop the audio
         void set_audio_state(bool playing){
-            SDL_PauseAudioDevice(sdl_audio_device_id, playing ? 0 : 1);
+            audio.set_gate(playing);
         }
 
         void poll_event(){
@@ -142,6 +156,11 @@ class frontend_sdl{
             return sdl_event.type == SDL_QUIT;
         }
 
+        /// backspace is held down
+        bool get_rewind_requested(){
+            return keys[SDL_SCANCODE_BACKSPACE];
+        }
+
         void set_draw_disabled(bool disabled){
             draw_disabled = disabled;
         }
@@ -198,32 +217,77 @@ class frontend_sdl{
             }
         }
 
-        void draw(int x, int y, std::array<uint8_t, 3> color){
+        /// RGB888 value of a color
+        static uint32_t rgb(const std::array<uint8_t, 3> &color){
+            return (uint32_t(color[0]) << 16) | (color[1] << 8) | color[2];
+        }
+
+        void fill_rect(int x, int y, int width, int height, std::array<uint8_t, 3> color){
             if(draw_disabled) return;
 
-            SDL_Rect rect;
-            rect.x = x * scale;
-            rect.y = y * scale;
-            rect.w = scale;
-            rect.h = scale;
+            uint32_t value = rgb(color);
+            for(int row = y; row < y + height; row++){
+                std::fill_n(&pixels[row * render_width + x], width, value);
+            }
+            pixels_changed = true;
+        }
+
+        void blit_row(int x, int y, int width, const std::array<uint8_t, 3> *colors){
+            if(draw_disabled) return;
 
-            SDL_SetRenderDrawColor(sdl_renderer, color.at(0), color.at(1), color.at(2), 0x00);
-            SDL_RenderFillRect(sdl_renderer, &rect);
+            std::transform(colors, colors + width, &pixels[y * render_width + x], rgb);
+            pixels_changed = true;
         }
 
         void clear(std::array<uint8_t, 3> color){
             if(draw_disabled) return;
 
-            SDL_SetRenderDrawColor(sdl_renderer, color.at(0), color.at(1), color.at(2), 0x00);
-            SDL_RenderClear(sdl_renderer);
+            std::fill(pixels.begin(), pixels.end(), rgb(color));
+            pixels_changed = true;
+        }
+
+        /// move the image by dx, dy pixels and fill the uncovered area with color
+        void scroll(int dx, int dy, std::array<uint8_t, 3> color){
+            if(draw_disabled) return;
+
+            uint32_t background = rgb(color);
+            int width = render_width - std::abs(dx);
+
+            // rows are copied in the direction that doesn't overwrite unread ones
+            for(int i = 0; i < render_height; i++){
+                int y = dy > 0 ? render_height - 1 - i : i;
+                uint32_t *row = &pixels[y * render_width];
+                int source_y = y - dy;
+
+                if(source_y < 0 || source_y >= render_height || width <= 0){
+                    std::fill(row, row + render_width, background);
+                    continue;
+                }
+
+                const uint32_t *source = &pixels[source_y * render_width];
+                if(dx >= 0){
+                    std::copy_backward(source, source + width, row + render_width);
+                    std::fill(row, row + dx, background);
+                }else{
+                    std::copy(source - dx, source + render_width, row);
+                    std::fill(row + width, row + render_width, background);
+                }
+            }
+            pixels_changed = true;
         }
 
+        /// upload the image with a single texture update and let the renderer scale it
         void refresh(){
+            // refresh() is called once per emulated frame
+            audio.end_frame();
+
             if(SDL_GetTicks64() >= time_to_refresh){
-                SDL_SetRenderTarget(sdl_renderer, NULL);
+                if(pixels_changed){
+                    SDL_UpdateTexture(sdl_texture, NULL, pixels.data(), render_width * sizeof(uint32_t));
+                    pixels_changed = false;
+                }
                 SDL_RenderCopy(sdl_renderer, sdl_texture, NULL, NULL);
                 SDL_RenderPresent(sdl_renderer);
-                SDL_SetRenderTarget(sdl_renderer, sdl_texture);
 
                 time_to_refresh = SDL_GetTicks64() + frame_time;
             }
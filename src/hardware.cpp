@@ -1,20 +1,80 @@
+#include <algorithm>
 #include <array>
+#include <bit>
+#include <stdexcept>
 #include <vector>
 #include <chrono>
 #include <fstream>
-#include <stack>
-#include <cstdlib>
-#include <ctime>
-
-extern "C"
-{
-#include <lua.h>
-#include <lauxlib.h>
-#include <lualib.h>
-}
+#include <string>
+#include <type_traits>
+#include <random>
 
 namespace chip8{
-    template<class palette_t> class chip8_hardware {
+    /** The emulated state of the machine.
+    It has a fixed size and no pointers, so a copy of the machine is a single memcpy.
+    The registers and everything else that most instructions touch share the first cache line,
+    the large arrays follow in the order of their use.
+    */
+    struct alignas(64) machine_state{
+        static constexpr size_t max_memory_size = 0x10000;
+        static constexpr unsigned int max_screen_x = 128;
+        static constexpr unsigned int max_screen_y = 64;
+        static constexpr unsigned int max_screen_planes = 4;
+        static constexpr size_t max_screen_words = (max_screen_x + 63) / 64;
+        /// return addresses, programs that call deeper stop with an error
+        static constexpr size_t call_stack_size = 256;
+
+        /// registers V0-Vf
+        std::array<uint8_t, 16> registers{};
+        /// flag registers (used only for e.g. SUPER-CHIP)
+        std::array<uint8_t, 16> flag_registers{};
+        /// program counter
+        uint16_t pc = 0;
+        /// register I (16 bit for a memory address)
+        uint16_t register_I = 0x0000;
+        /// RD.0 register (used for some opcode combinations)
+        uint8_t register_rd0 = 0x00;
+        uint8_t delay_timer = 0x00, sound_timer = 0x00;
+        bool waiting_for_timer = false;
+        /// register that receives the next key, -1 if not waiting
+        int waiting_for_key = -1;
+        /// pressed keys, bit n is key n
+        uint16_t keyboard_1 = 0, keyboard_2 = 0;
+        /// number of used call_stack entries
+        uint16_t call_stack_depth = 0;
+        /// active screen planes, bit n is plane n
+        uint8_t active_screen_planes = 0x01;
+        /// high resolution mode for SUPER-CHIP
+        bool high_res = false;
+        /// background color for CHIP-8X
+        uint8_t screen_bg_color = 0x00;
+        /// the display is switched off (ETI-660)
+        bool draw_disabled = false;
+        /// state of the xorshift random number generator, never 0
+        uint64_t random_state = 1;
+
+        /// audio pitch in pattern bits per second and pattern (XO-CHIP), as last sent to the frontend
+        double audio_frequency = 4000.0;
+        std::array<uint8_t, 16> audio_pattern = []{
+            std::array<uint8_t, 16> pattern;
+            pattern.fill(0x0f);
+            return pattern;
+        }();
+
+        /// call stack (for returning from subroutines)
+        std::array<uint16_t, call_stack_size> call_stack{};
+
+        /// packed screen content, one bit per pixel and rows of screen_words words, the leftmost pixel is the most significant bit
+        std::array<uint64_t, max_screen_planes * max_screen_y * max_screen_words> screen_content{};
+        /// foreground colors for CHIP-8X
+        std::array<std::array<uint8_t, max_screen_x>, max_screen_y> screen_fg_color{};
+
+        /// main memory
+        std::array<uint8_t, max_memory_size> memory{};
+    };
+    static_assert(std::is_trivially_copyable_v<machine_state>, "machine_state must be copyable with memcpy");
+
+    template<class palette_t> class chip8_hardware : protected machine_state{
 
         friend palette_t;
 
@@ -56,188 +116,357 @@ namespace chip8{
             /// start of the ASCII font (CHIP-8 for COSMAC ELF)
             uint16_t ascii_font_start = 0;
 
-            /// main memory
-            std::vector<uint8_t> memory;
-            /// size of `memory`
+            /// size of the emulated memory, the rest of machine_state::memory is unused
             size_t memory_size;
 
+            /// seed of random_state
+            uint64_t seed;
+
             /// start of the program
             uint16_t program_start;
-            
-            /// registers V0-Vf
-            std::array<uint8_t, 16> registers;
-            
-            /// register I (16 bit for a memory address)
-            uint16_t register_I = 0x0000;
 
-            /// flag registers (used only for e.g. SUPER-CHIP)
-            std::array<uint8_t, 16> flag_registers;
-
-            /// RD.0 register (used for some opcode combinations)
-            uint8_t register_rd0;
-            
             // timers
             static constexpr int timer_delay = 1000000 / 60; // microseconds
             std::chrono::time_point<std::chrono::steady_clock> timer_start;
-            uint8_t delay_timer = 0x00, sound_timer = 0x00;
-            bool waiting_for_timer = false;
+            /// instructions per 60 Hz frame
+            unsigned int cycles_per_frame;
             
             // screen content
             unsigned int screen_x;
             unsigned int screen_y;
             unsigned int screen_planes;
-            std::vector<std::vector<std::vector<uint8_t>>> screen_content;
+            /// 64 bit words per screen row
+            unsigned int screen_words;
+            /// width of a damage tile in pixels, a tile row fits into one word
+            unsigned int damage_tile_x;
+            /// height of a damage tile in pixels
+            static constexpr unsigned int damage_tile_y = 4;
+            /// tiles changed since the last present, one word per tile row, bit n is tile column n
+            std::vector<uint64_t> screen_damage;
             bool allow_high_res;
-            bool high_res = false; // high resolution mode for SUPER-CHIP
-
-            /// stores which screen planes are active
-            std::vector<bool> active_screen_planes;
-
-            /// foreground colors for CHIP-8X
-            std::vector<std::vector<uint8_t>> screen_fg_color;
-            /// background color for CHIP-8X
-            uint8_t screen_bg_color;
 
             /// color palette
             palette_t palette;
-            
-            /// program counter
-            uint16_t pc;
-            
-            /// call stack (for returning from subroutines)
-            std::stack< uint16_t > call_stack;
 
-            // currently pressed key
-            std::array<bool, 16> keyboard_1, keyboard_2;
-            int waiting_for_key = -1;
+            uint8_t &memory_at(size_t address){
+                if(address >= memory_size){
+                    throw std::out_of_range("memory address out of range");
+                }
+                return memory[address];
+            }
+
+            void call_stack_push(uint16_t address){
+                if(call_stack_depth == call_stack.size()){
+                    throw std::runtime_error("call stack overflow");
+                }
+                call_stack[call_stack_depth++] = address;
+            }
+
+            uint16_t call_stack_pop(){
+                if(call_stack_depth == 0){
+                    throw std::runtime_error("call stack empty - can not return");
+                }
+                return call_stack[--call_stack_depth];
+            }
+
+            /// returns true if the key is pressed on a keyboard (keyboard_1 or keyboard_2)
+            static bool key_pressed(uint16_t keyboard, size_t key){
+                if(key >= 16){
+                    throw std::out_of_range("key out of range");
+                }
+                return (keyboard >> key) & 1;
+            }
+
+            bool plane_active(size_t plane){
+                return (active_screen_planes >> plane) & 1;
+            }
+
+            /// next random byte (xorshift64*), each instance has its own sequence
+            uint8_t random_byte(){
+                random_state ^= random_state >> 12;
+                random_state ^= random_state << 25;
+                random_state ^= random_state >> 27;
+                return (random_state * 0x2545f4914f6cdd1d) >> 56;
+            }
+
+            /// returns the words of a screen row
+            uint64_t *screen_row(size_t plane, size_t y){
+                if(plane >= screen_planes || y >= screen_y){
+                    throw std::out_of_range("screen row out of range");
+                }
+                return screen_content.data() + (plane * screen_y + y) * screen_words;
+            }
 
             uint8_t screen_get(size_t plane, size_t x, size_t y){
-                return screen_content.at(plane).at(y).at(x);
+                if(x >= screen_x){
+                    throw std::out_of_range("screen column out of range");
+                }
+                return (screen_row(plane, y)[x / 64] >> (63 - x % 64)) & 0x01;
+            }
+
+            /// mark a rectangle as changed, it is clipped at the screen border
+            void screen_damage_rect(size_t x, size_t y, size_t width, size_t height){
+                if(x >= screen_x || y >= screen_y || width == 0 || height == 0) return;
+
+                size_t first = x / damage_tile_x;
+                size_t last = (std::min<size_t>(x + width, screen_x) - 1) / damage_tile_x;
+                uint64_t tiles = (~uint64_t(0) >> (63 - last)) & (~uint64_t(0) << first);
+
+                size_t last_row = (std::min<size_t>(y + height, screen_y) - 1) / damage_tile_y;
+                for(size_t row = y / damage_tile_y; row <= last_row; row++){
+                    screen_damage[row] |= tiles;
+                }
             }
 
-            template<class frontend> void screen_set(size_t plane, size_t x, size_t y, uint8_t value, frontend &f){
-                screen_content.at(plane).at(y).at(x) = value;
+            void screen_damage_all(){
+                screen_damage_rect(0, 0, screen_x, screen_y);
+            }
+
+            /**
+             * @brief call function(x, y, width, height) for every changed rectangle and reset the damage
+             *
+             * A run of changed tiles in a tile row is merged with the same run in the rows below it.
+             */
+            template<class function> void screen_take_damage(function callback){
+                const size_t rows = screen_damage.size();
+
+                for(size_t row = 0; row < rows; row++){
+                    uint64_t tiles = screen_damage[row];
+                    while(tiles){
+                        unsigned int first = std::countr_zero(tiles);
+                        unsigned int count = std::countr_one(tiles >> first);
+                        uint64_t run = (count == 64 ? ~uint64_t(0) : (uint64_t(1) << count) - 1) << first;
+
+                        size_t last_row = row;
+                        while(last_row + 1 < rows && (screen_damage[last_row + 1] & run) == run){
+                            last_row++;
+                            screen_damage[last_row] &= ~run;
+                        }
+                        tiles &= ~run;
+
+                        size_t x = first * damage_tile_x;
+                        size_t y = row * damage_tile_y;
+                        callback(x, y,
+                            std::min<size_t>(count * damage_tile_x, screen_x - x),
+                            std::min<size_t>((last_row - row + 1) * damage_tile_y, screen_y - y));
+                    }
+                    screen_damage[row] = 0;
+                }
+            }
+
+            /// set a pixel and mark it as changed
+            void screen_put(size_t plane, size_t x, size_t y, uint8_t value){
+                if(x >= screen_x){
+                    throw std::out_of_range("screen column out of range");
+                }
+                uint64_t &word = screen_row(plane, y)[x / 64];
+                uint64_t bit = uint64_t(1) << (63 - x % 64);
+                word = value ? word | bit : word & ~bit;
+                screen_damage_rect(x, y, 1, 1);
+            }
 
-                f.draw(x, y, palette.color(this, x, y));
+            /// returns true if no pixel of the plane is set
+            bool screen_plane_empty(size_t plane){
+                uint64_t *first = screen_row(plane, 0);
+                return std::all_of(first, first + screen_y * screen_words, [](uint64_t word){ return word == 0; });
+            }
+
+            /// shift a row by n pixels to the right (negative: left), pixels moved out of the screen are lost
+            void screen_shift_row(uint64_t *row, int n){
+                const int words = screen_words;
+                const int word_shift = std::abs(n) / 64;
+                const int bit_shift = std::abs(n) % 64;
+
+                if(n > 0){
+                    for(int word = words - 1; word >= 0; word--){
+                        int source = word - word_shift;
+                        uint64_t high = source >= 0 ? row[source] >> bit_shift : 0;
+                        uint64_t low = bit_shift && source >= 1 ? row[source - 1] << (64 - bit_shift) : 0;
+                        row[word] = high | low;
+                    }
+
+                    // clear the pixels right of the screen
+                    if(screen_x % 64) row[words - 1] &= ~uint64_t(0) << (64 - screen_x % 64);
+                }else if(n < 0){
+                    for(int word = 0; word < words; word++){
+                        int source = word + word_shift;
+                        uint64_t high = source < words ? row[source] << bit_shift : 0;
+                        uint64_t low = bit_shift && source + 1 < words ? row[source + 1] >> (64 - bit_shift) : 0;
+                        row[word] = high | low;
+                    }
+                }
+            }
+
+            /// scroll a plane by dx, dy pixels, pixels moved out of the screen are lost
+            void screen_shift(size_t plane, int dx, int dy){
+                const int rows = screen_y;
+                const int words = screen_words;
+                uint64_t *first = screen_row(plane, 0);
+
+                if(std::abs(dy) >= rows){
+                    std::fill_n(first, rows * words, 0);
+                }else if(dy > 0){
+                    std::copy_backward(first, first + (rows - dy) * words, first + rows * words);
+                    std::fill_n(first, dy * words, 0);
+                }else if(dy < 0){
+                    std::copy(first - dy * words, first + rows * words, first);
+                    std::fill_n(first + (rows + dy) * words, -dy * words, 0);
+                }
+
+                if(dx){
+                    for(int y = 0; y < rows; y++){
+                        screen_shift_row(first + y * words, dx);
+                    }
+                }
+            }
+
+            /**
+             * @brief xor up to 64 pixels into a screen row and mark the changed pixels
+             *
+             * Pixels right of the screen are clipped.
+             * @param bits the pixels, the leftmost pixel is the most significant bit
+             * @param width number of pixels in bits
+             * @return number of pixels that were turned off
+             */
+            unsigned int screen_xor(size_t plane, size_t x, size_t y, uint64_t bits, unsigned int width){
+                uint64_t *row = screen_row(plane, y);
+                if(x >= screen_x || width == 0) return 0;
+
+                width = std::min<size_t>(width, screen_x - x);
+                bits &= ~uint64_t(0) << (64 - width);
+
+                size_t word = x / 64;
+                unsigned int offset = x % 64;
+                unsigned int collisions = 0;
+
+                for(uint64_t part : {bits >> offset, offset ? bits << (64 - offset) : 0}){
+                    if(part){
+                        collisions += std::popcount(row[word] & part);
+                        row[word] ^= part;
+
+                        unsigned int first = std::countl_zero(part);
+                        screen_damage_rect(word * 64 + first, y, 64 - std::countr_zero(part) - first, 1);
+                    }
+                    word++;
+                }
+
+                return collisions;
             }
         
         public:
-            void load_config(lua_State *L){
-                palette.load_config(L);
-
-                lua_getfield(L, -1, "x");
-                screen_x = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : 64;
-                lua_pop(L, 1);
-
-                lua_getfield(L, -1, "y");
-                screen_y = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : 32;
-                lua_pop(L, 1);
-
-                lua_getfield(L, -1, "planes");
-                screen_planes = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : 1;
-                lua_pop(L, 1);
-
-                lua_getfield(L, -1, "program_start");
-                program_start = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : 0x0200;
-                lua_pop(L, 1);
-
-                lua_getfield(L, -1, "memory_size");
-                memory_size = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : 4096;
-                lua_pop(L, 1);
-
-                lua_getfield(L, -1, "allow_high_res");
-                allow_high_res = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                lua_pop(L, 1);
-
-                lua_getfield(L, -1, "ascii_font_start");
-                ascii_font_start = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : false;
-                lua_pop(L, 1);
-            }
-
-            void load_font(lua_State *L){
-                lua_getfield(L, -1, "font");
-                if(lua_istable(L, -1)){
-                    lua_pushnil(L);
-                    while(lua_next(L, -2)){
-                        if(lua_isinteger(L, -2) &&  lua_istable(L, -1)){
-                            size_t offset = lua_tointeger(L, -2);
-                            size_t length = lua_rawlen(L, -1);
-
-                            for(size_t i = 0; i < length; i++){
-                                lua_geti(L, -1, i + 1);
-                                memory.at(offset) = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : 0x00;
-                                offset++;
-                                lua_pop(L, 1);
-                            }
+            void load_config(const mode_config &m){
+                palette.load_config(m);
+
+                screen_x = m.screen_x;
+                screen_y = m.screen_y;
+                screen_planes = m.screen_planes;
+                program_start = m.program_start;
+                cycles_per_frame = m.cycles_per_frame;
+                memory_size = m.memory_size;
+                allow_high_res = m.allow_high_res;
+                ascii_font_start = m.ascii_font_start;
+            }
+
+            void load_font(const mode_config &m){
+                if(m.custom_font){
+                    for(const auto &[start, bytes] : m.font){
+                        size_t offset = start;
+                        for(uint8_t byte : bytes){
+                            memory_at(offset) = byte;
+                            offset++;
                         }
-                        lua_pop(L, 1);
                     }
                 }else{
                     // small font
                     for(size_t i = 0; i < font.size(); i++){
-                    memory.at(i) = font.at(i);
+                    memory_at(i) = font.at(i);
                     }
 
                     // big font
                     for(size_t i = 0; i < big_font.size(); i++){
-                        memory.at(80 + i) = big_font.at(i);
+                        memory_at(80 + i) = big_font.at(i);
                     }
                 }
-                lua_pop(L, 1);
             }
             
-            explicit chip8_hardware(lua_State *L){
-                load_config(L);
+            explicit chip8_hardware(const mode_config &m){
+                load_config(m);
 
-                // resize and initialize memory
-                memory.resize(memory_size);
-                for(size_t i = 0; i < memory.size(); i++){
-                    memory.at(i) = 0x00;
+                if(memory_size > max_memory_size){
+                    throw std::runtime_error("memory_size is larger than " + std::to_string(max_memory_size));
+                }
+                if(screen_x > max_screen_x || screen_y > max_screen_y || screen_planes == 0 || screen_planes > max_screen_planes){
+                    throw std::runtime_error("unsupported screen, the largest is " + std::to_string(max_screen_x) + "x" + std::to_string(max_screen_y) + " with " + std::to_string(max_screen_planes) + " planes");
                 }
 
+                // screen layout and damage tiles
+                screen_words = (screen_x + 63) / 64;
+                damage_tile_x = 8 * ((screen_x + 511) / 512);
+                screen_damage.assign((screen_y + damage_tile_y - 1) / damage_tile_y, 0);
+
+                reset(m);
+            }
+
+            /**
+             * @brief put the machine into its state after power on, without a program
+             *
+             * @param m the mode the machine was created with
+             */
+            void reset(const mode_config &m){
+                static_cast<machine_state &>(*this) = machine_state{};
+
                 // font
-                load_font(L);
+                load_font(m);
 
-                // initialize registers
-                registers.fill(0x00);
-                flag_registers.fill(0x00);
-                register_rd0 = 0x00;
                 pc = program_start;
 
-                // resize and initialze screen content
-                screen_content.resize(screen_planes);
-                for(unsigned int plane = 0; plane < screen_content.size(); plane++){
-                    screen_content.at(plane).resize(screen_y);
-                    for(unsigned int y = 0; y < screen_content.at(plane).size(); y++){
-                        screen_content.at(plane).at(y).resize(screen_x);
-                        for(unsigned int x = 0; x < screen_content.at(plane).at(y).size(); x++){
-                            screen_content.at(plane).at(y).at(x) = 0x00;
-                        }
-                    }
-                }
+                std::fill(screen_damage.begin(), screen_damage.end(), 0);
 
                 // screen colors
-                screen_fg_color.resize(screen_y);
-                for(unsigned int y = 0; y < screen_fg_color.size(); y++){
-                    screen_fg_color.at(y).resize(screen_x);
-                    for(unsigned int x = 0; x < screen_fg_color.at(y).size(); x++){
-                        screen_fg_color.at(y).at(x) = 0x07;
-                    }
+                for(std::array<uint8_t, max_screen_x> &row : screen_fg_color){
+                    row.fill(0x07);
                 }
-                screen_bg_color = 0x00;
 
-                active_screen_planes.resize(screen_planes);
-                for(unsigned int plane = 0; plane < screen_content.size(); plane++){
-                    active_screen_planes.at(plane) = false;
+                set_seed(m.seed);
+
+                timer_start = std::chrono::steady_clock::now();
+            }
+
+            /**
+             * @brief restart the random numbers from a seed
+             *
+             * @param s the seed, 0 picks one from the system
+             */
+            void set_seed(uint64_t s){
+                if(!s){
+                    std::random_device device;
+                    s = (uint64_t(device()) << 32) | device();
+                    if(!s) s = 1;
                 }
-                active_screen_planes.at(0) = true;
+                seed = s;
+
+                // splitmix64, so that similar seeds give unrelated sequences
+                uint64_t z = s + 0x9e3779b97f4a7c15;
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+                z ^= z >> 31;
+                random_state = z ? z : 1;
+            }
 
-                keyboard_1.fill(false);
-                keyboard_2.fill(false);
+            /// the seed of the random numbers, also the one picked for seed 0
+            uint64_t get_seed(){
+                return seed;
+            }
 
-                std::srand(std::time(nullptr));
+            /// FNV-1a hash of the pixels of all screen planes, independent of the palette
+            uint64_t get_screen_hash(){
+                return fnv1a(screen_content.data(), screen_planes * screen_y * screen_words * sizeof(uint64_t));
+            }
 
-                timer_start = std::chrono::steady_clock::now();
+            /// the opcode before pc, after a stop or most errors the one that caused it, 0 if pc is outside of the memory
+            uint16_t get_previous_opcode(){
+                if(pc < 2 || pc > memory_size) return 0;
+                return (memory[pc - 2] << 8) | memory[pc - 1];
             }
 
             /// load file into memory
@@ -249,7 +478,7 @@ namespace chip8{
                 while(address < memory_size){
                     uint8_t i = instream.get();
                     if(instream.eof()) break;
-                    memory.at(address) = i;
+                    memory_at(address) = i;
                     address++;
                 }
                 instream.close();
@@ -257,12 +486,28 @@ namespace chip8{
                 return 0;
             }
 
+            /// load a program that is already in memory
+            void load_program(const std::vector<uint8_t> &program){
+                size_t address = pc;
+                for(uint8_t byte : program){
+                    if(address >= memory_size) break;
+                    memory_at(address) = byte;
+                    address++;
+                }
+            }
+
+            uint16_t get_program_start(){
+                return program_start;
+            }
+
             void set_key(int keyboard, int key, bool pressed){
-                if(keyboard == 1){
-                    keyboard_1.at(key) = pressed;
-                }else if(keyboard == 2){
-                    keyboard_2.at(key) = pressed;
+                if(keyboard != 1 && keyboard != 2) return;
+                if(key < 0 || key >= 16){
+                    throw std::out_of_range("key out of range");
                 }
+
+                uint16_t &keys = keyboard == 1 ? keyboard_1 : keyboard_2;
+                keys = pressed ? keys | (1u << key) : keys & ~(1u << key);
             }
 
             int get_screen_x(){
@@ -273,6 +518,19 @@ namespace chip8{
                 return screen_y;
             }
 
+            unsigned int get_screen_planes(){
+                return screen_planes;
+            }
+
+            /// returns 1 if the pixel is set on the plane
+            uint8_t get_pixel(size_t plane, size_t x, size_t y){
+                return screen_get(plane, x, y);
+            }
+
+            unsigned int get_cycles_per_frame(){
+                return cycles_per_frame;
+            }
+
             /* debug functions
             void print_registers(std::ostream &outstream){
                 outstream << "I=" << std::setw(4) << std::setfill('0') << std::hex << register_I << " ";
@@ -291,7 +549,8 @@ namespace chip8{
                 << "program start                   0x" << std::hex << std::setw(4) << std::setfill('0') << program_start << std::dec << std::setw(0) << std::setfill(' ') << "\n"
                 << "ascii font start                0x" << std::hex << std::setw(4) << std::setfill('0') << ascii_font_start << std::dec << std::setw(0) << std::setfill(' ') << "\n"
                 << "screen resolution               " << screen_x << "x" << screen_y << "x" << screen_planes << "\n"
-                << "high/low resolution modes       " << (allow_high_res ? "true\n" : "false\n");
+                << "high/low resolution modes       " << (allow_high_res ? "true\n" : "false\n")
+                << "cycles per frame                " << cycles_per_frame << "\n";
             }
     };
 }
\ No newline at end of file
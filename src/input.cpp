@@ -0,0 +1,158 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace chip8{
+    /// a key change and the emulated frame it happened in
+    struct input_event{
+        /// number of frames executed before the change
+        uint64_t frame;
+        uint8_t keyboard;
+        uint8_t key;
+        bool pressed;
+    };
+
+    /** The key input of a run, to replay it exactly.
+    Key changes are counted in emulated frames, not host time, and the seed of the random numbers is recorded with them,
+    so a replay with frame or cycle timers executes the same instructions as the recorded run, also headless in turbo mode.
+    */
+    class input_recording{
+        public:
+            struct header{
+                char magic[8];
+                uint32_t version;
+                uint32_t reserved;
+                /// mode_config::hash() of the recorded mode
+                uint64_t mode_hash;
+                /// seed of the random numbers
+                uint64_t seed;
+            };
+            static constexpr char magic[8] = {'C', 'H', 'I', 'P', '8', 'I', 'N', 'P'};
+            /// increase on every change of the header or the event format
+            static constexpr uint32_t version = 1;
+
+            /**
+             * @brief start a recording file, the events are appended as they happen
+             *
+             * @throw std::runtime_error if the file can't be written
+             */
+            void record(const std::string &filename, uint64_t mode_hash, uint64_t seed){
+                file.open(filename, std::ios::binary | std::ios::trunc);
+
+                header h{};
+                std::memcpy(h.magic, magic, sizeof(h.magic));
+                h.version = version;
+                h.mode_hash = mode_hash;
+                h.seed = seed;
+                file.write(reinterpret_cast<const char *>(&h), sizeof(h));
+                file.flush();
+
+                if(!file){
+                    throw std::runtime_error("couldn't write " + filename);
+                }
+            }
+
+            /**
+             * @brief read a recording for replay
+             *
+             * @return the header with the mode hash and seed of the recorded run
+             * @throw std::runtime_error if the file is missing, damaged or from another version
+             */
+            header replay(const std::string &filename){
+                std::ifstream in(filename, std::ios::binary);
+                if(!in){
+                    throw std::runtime_error("couldn't open " + filename);
+                }
+
+                header h;
+                in.read(reinterpret_cast<char *>(&h), sizeof(h));
+                if(!in || std::memcmp(h.magic, magic, sizeof(h.magic)) != 0 || h.version != version){
+                    throw std::runtime_error("unsupported input recording version");
+                }
+
+                events.clear();
+                uint8_t record[event_size];
+                while(in.read(reinterpret_cast<char *>(record), event_size)){
+                    input_event event;
+                    std::memcpy(&event.frame, record, sizeof(event.frame));
+                    event.keyboard = record[8];
+                    event.key = record[9];
+                    event.pressed = record[10];
+                    if(event.keyboard < 1 || event.keyboard > 2 || event.key >= 16 || (!events.empty() && event.frame < events.back().frame)){
+                        throw std::runtime_error("damaged input recording");
+                    }
+                    events.push_back(event);
+                }
+                next = 0;
+                replaying = true;
+                return h;
+            }
+
+            bool is_replaying() const{
+                return replaying;
+            }
+
+            /// append an event to the recording file, flushed at once so that a crash doesn't lose it
+            void add(const input_event &event){
+                if(!file.is_open()) return;
+
+                uint8_t record[event_size] = {};
+                std::memcpy(record, &event.frame, sizeof(event.frame));
+                record[8] = event.keyboard;
+                record[9] = event.key;
+                record[10] = event.pressed;
+                file.write(reinterpret_cast<const char *>(record), event_size);
+                file.flush();
+            }
+
+            /// pass the replayed events of a frame to c8
+            template<class chip8_class> void apply(chip8_class &c8, uint64_t frame){
+                for(; next < events.size() && events[next].frame <= frame; next++){
+                    c8.set_key(events[next].keyboard, events[next].key, events[next].pressed);
+                }
+            }
+
+        private:
+            /// frame (8 bytes, native byte order), keyboard, key, pressed, padding
+            static constexpr size_t event_size = 16;
+
+            std::ofstream file;
+            std::vector<input_event> events;
+            size_t next = 0;
+            bool replaying = false;
+    };
+
+    /** Takes the keys from the frontend once per frame and records them, or replays a recording instead.
+    Frontends call set_key() of this like the one of the interpreter.
+    */
+    template<class chip8_class> class input_log{
+        public:
+            input_log(chip8_class &c8, input_recording &recording) : c8(c8), recording(recording){}
+
+            /// forwarded from the frontend
+            void set_key(int keyboard, int key, bool pressed){
+                if(recording.is_replaying()) return;
+
+                c8.set_key(keyboard, key, pressed);
+                if(keyboard == 1 || keyboard == 2){
+                    recording.add({frame, static_cast<uint8_t>(keyboard), static_cast<uint8_t>(key), pressed});
+                }
+            }
+
+            /// call at the start of every frame
+            template<class frontend_class> void get_keys(frontend_class &f){
+                f.get_keys(*this);
+                if(recording.is_replaying()) recording.apply(c8, frame);
+                frame++;
+            }
+
+        private:
+            chip8_class &c8;
+            input_recording &recording;
+            /// frames executed so far
+            uint64_t frame = 0;
+    };
+}
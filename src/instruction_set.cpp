@@ -1,4 +1,82 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
 namespace chip8{
+    /** The operations an opcode can decode to.
+    Extension specific operations are suffixed with the name of the extension.
+    */
+    enum class operation : uint8_t{
+        unknown,
+
+        // CHIP-8E
+        op_00ed_chip8e, op_00f2_chip8e, op_0151_chip8e, op_0188_chip8e,
+        op_5xy1_chip8e, op_5xy2_chip8e, op_5xy3_chip8e, op_bbnn_chip8e, op_bfnn_chip8e,
+        op_fx03_chip8e, op_fx1b_chip8e, op_fx4f_chip8e, op_fxe3_chip8e, op_fxe7_chip8e,
+
+        // SUPER-CHIP 1.0
+        op_00fd_schip10, op_00fe_schip10, op_00ff_schip10, op_fx75_schip10, op_fx85_schip10,
+
+        // SUPER-CHIP 1.1
+        op_00cn_schip11, op_00fb_schip11, op_00fc_schip11, op_fx30_schip11,
+
+        // fxf2, 00bn
+        op_fxf2, op_00bn,
+
+        // CHIP-8X
+        op_02a0_chip8x, op_5xy1_chip8x, op_bxy0_chip8x, op_bxyn_chip8x,
+        op_exf2_chip8x, op_exf5_chip8x, op_fxf8_chip8x, op_fxfb_chip8x,
+
+        // XO-CHIP
+        op_00dn_xochip, op_5xy2_xochip, op_5xy3_xochip, op_f000_xochip, op_fn01_xochip, op_f002_xochip, op_fx3a_xochip,
+
+        // 0000
+        op_0000,
+
+        // chip8run
+        op_001n_chip8run, op_00fa_chip8run,
+
+        // ETI-660
+        op_fx00_eti660, op_00f8_eti660, op_00fc_eti660, op_00ff_eti660,
+        op_07a2_eti660color, op_07c1_eti660color, op_27ab_eti660color,
+        op_049f_eti660color_highres, op_04a2_eti660color_highres, op_04b2_eti660color_highres,
+
+        // CHIP-8 for COSMAC ELF
+        op_5xy1_chip8elf, op_5xy2_chip8elf, op_5xy3_chip8elf, op_9xy1_chip8elf, op_9xy2_chip8elf, op_9xy3_chip8elf,
+        op_fx75_chip8elf, op_fx94_chip8elf, op_ffff_chip8elf,
+
+        // CHIP-8
+        op_00e0, op_00ee, op_0nnn, op_1nnn, op_2nnn, op_3xnn, op_4xnn, op_5xy0, op_6xnn, op_7xnn,
+        op_8xy0, op_8xy1, op_8xy2, op_8xy3, op_8xy4, op_8xy5, op_8xy6, op_8xy7, op_8xye, op_9xy0,
+        op_annn, op_bnnn, op_cxnn, op_dxyn, op_ex9e, op_exa1,
+        op_fx07, op_fx0a, op_fx15, op_fx18, op_fx1e, op_fx29, op_fx33, op_fx55, op_fx65,
+    };
+
+    /// a decoded opcode with its operands split into nibbles and bytes
+    struct instruction{
+        operation op;
+        uint8_t x, y, n;
+        uint8_t nn;
+        uint16_t nnn;
+    };
+
+    /// one bit per instruction set extension, used to describe an instruction set at compile time
+    namespace instruction_set_flags{
+        constexpr uint32_t chip8e = 1u << 0;
+        constexpr uint32_t super_chip_1_0 = 1u << 1;
+        constexpr uint32_t super_chip_1_1 = 1u << 2;
+        constexpr uint32_t scroll_up_00bn = 1u << 3;
+        constexpr uint32_t set_rd0_fxf2 = 1u << 4;
+        constexpr uint32_t chip8x = 1u << 5;
+        constexpr uint32_t xochip = 1u << 6;
+        constexpr uint32_t stop_0000 = 1u << 7;
+        constexpr uint32_t chip8run = 1u << 8;
+        constexpr uint32_t eti660 = 1u << 9;
+        constexpr uint32_t eti660color = 1u << 10;
+        constexpr uint32_t eti660color_highres = 1u << 11;
+        constexpr uint32_t chip8elf = 1u << 12;
+    }
+
     /** The available instruction set extensions.
     The instruction set only determines which opcodes are available, not their behaviour.
     */
@@ -31,63 +109,226 @@ namespace chip8{
             /// the extensions from CHIP-8 for COSMAC ELF
             bool chip8elf = false;
 
+            /// use the dispatch table instead of decoding every opcode
+            bool table_decoder = false;
+            /// the operation of every opcode, built once if table_decoder is set
+            std::vector<operation> dispatch_table;
+
+            /** decode an opcode by testing each enabled extension in order, the base instruction set comes last
+             *
+             * @tparam iset instruction set whose flags are tested, may be a chip8_instruction_set_fixed
+             */
+            template<class iset> static operation decode(const iset &s, uint16_t opcode){
+                uint8_t high = opcode >> 8, low = opcode & 0xff;
+                uint8_t high_h = (high >> 4), low_h = low >> 4, low_l = low & 0x0f;
+
+                if(s.chip8e){
+                    if(opcode == 0x00ed) return operation::op_00ed_chip8e;
+                    if(opcode == 0x00f2) return operation::op_00f2_chip8e;
+                    if(opcode == 0x0151) return operation::op_0151_chip8e;
+                    if(opcode == 0x0188) return operation::op_0188_chip8e;
+                    if(high_h == 0x05 && low_l == 0x01) return operation::op_5xy1_chip8e;
+                    if(high_h == 0x05 && low_l == 0x02) return operation::op_5xy2_chip8e;
+                    if(high_h == 0x05 && low_l == 0x03) return operation::op_5xy3_chip8e;
+                    if(high == 0xbb) return operation::op_bbnn_chip8e;
+                    if(high == 0xbf) return operation::op_bfnn_chip8e;
+                    if(high_h == 0x0f && low == 0x03) return operation::op_fx03_chip8e;
+                    if(high_h == 0x0f && low == 0x1b) return operation::op_fx1b_chip8e;
+                    if(high_h == 0x0f && low == 0x4f) return operation::op_fx4f_chip8e;
+                    if(high_h == 0x0f && low == 0xe3) return operation::op_fxe3_chip8e;
+                    if(high_h == 0x0f && low == 0xe7) return operation::op_fxe7_chip8e;
+                }
+
+                if(s.super_chip_1_0){
+                    if(opcode == 0x00fd) return operation::op_00fd_schip10;
+                    if(opcode == 0x00fe) return operation::op_00fe_schip10;
+                    if(opcode == 0x00ff) return operation::op_00ff_schip10;
+                    if(high_h == 0x0f && low == 0x75) return operation::op_fx75_schip10;
+                    if(high_h == 0x0f && low == 0x85) return operation::op_fx85_schip10;
+                }
+
+                if(s.super_chip_1_1){
+                    if(high == 0x00 && low_h == 0x0c) return operation::op_00cn_schip11;
+                    if(opcode == 0x00fb) return operation::op_00fb_schip11;
+                    if(opcode == 0x00fc) return operation::op_00fc_schip11;
+                    if(high_h == 0x0f && low == 0x30) return operation::op_fx30_schip11;
+                }
+
+                if(s.set_rd0_fxf2){
+                    if(high_h == 0x0f && low == 0xf2) return operation::op_fxf2;
+                }
+
+                if(s.scroll_up_00bn){
+                    if(high_h == 0x00 && low_h == 0x0b) return operation::op_00bn;
+                }
+
+                if(s.chip8x){
+                    if(opcode == 0x02a0) return operation::op_02a0_chip8x;
+                    if(high_h == 0x05 && low_l == 0x01) return operation::op_5xy1_chip8x;
+                    if(high_h == 0x0b && low_l == 0x00) return operation::op_bxy0_chip8x;
+                    if(high_h == 0x0b) return operation::op_bxyn_chip8x;
+                    if(high_h == 0x0e && low == 0xf2) return operation::op_exf2_chip8x;
+                    if(high_h == 0x0e && low == 0xf5) return operation::op_exf5_chip8x;
+                    if(high_h == 0x0f && low == 0xf8) return operation::op_fxf8_chip8x;
+                    if(high_h == 0x0f && low == 0xfb) return operation::op_fxfb_chip8x;
+                }
+
+                if(s.xochip){
+                    if(high == 0x00 && low_h == 0x0d) return operation::op_00dn_xochip;
+                    if(high_h == 0x05 && low_l == 0x02) return operation::op_5xy2_xochip;
+                    if(high_h == 0x05 && low_l == 0x03) return operation::op_5xy3_xochip;
+                    if(opcode == 0xf000) return operation::op_f000_xochip;
+                    if(high_h == 0x0f && low == 0x01) return operation::op_fn01_xochip;
+                    if(opcode == 0xf002) return operation::op_f002_xochip;
+                    if(high_h == 0x0f && low == 0x3a) return operation::op_fx3a_xochip;
+                }
+
+                if(s.stop_0000){
+                    if(opcode == 0x0000) return operation::op_0000;
+                }
+
+                if(s.chip8run){
+                    if(high == 0x00 && low_h == 0x01) return operation::op_001n_chip8run;
+                    if(opcode == 0x00fa) return operation::op_00fa_chip8run;
+                }
+
+                if(s.eti660){
+                    if(high_h == 0x0f && low == 0x00) return operation::op_fx00_eti660;
+                    if(opcode == 0x00f8) return operation::op_00f8_eti660;
+                    if(opcode == 0x00fc) return operation::op_00fc_eti660;
+                    if(opcode == 0x00ff) return operation::op_00ff_eti660;
+                }
+
+                if(s.eti660color){
+                    if(opcode == 0x07a2) return operation::op_07a2_eti660color;
+                    if(opcode == 0x07c1) return operation::op_07c1_eti660color;
+                    if(opcode == 0x27ab) return operation::op_27ab_eti660color;
+                }
+
+                if(s.eti660color_highres){
+                    if(opcode == 0x049f) return operation::op_049f_eti660color_highres;
+                    if(opcode == 0x04a2) return operation::op_04a2_eti660color_highres;
+                    if(opcode == 0x04b2) return operation::op_04b2_eti660color_highres;
+                }
+
+                if(s.chip8elf){
+                    if(high_h == 0x05 && low_l == 0x01) return operation::op_5xy1_chip8elf;
+                    if(high_h == 0x05 && low_l == 0x02) return operation::op_5xy2_chip8elf;
+                    if(high_h == 0x05 && low_l == 0x03) return operation::op_5xy3_chip8elf;
+                    if(high_h == 0x09 && low_l == 0x01) return operation::op_9xy1_chip8elf;
+                    if(high_h == 0x09 && low_l == 0x02) return operation::op_9xy2_chip8elf;
+                    if(high_h == 0x09 && low_l == 0x03) return operation::op_9xy3_chip8elf;
+                    if(high_h == 0x0f && low == 0x75) return operation::op_fx75_chip8elf;
+                    if(high_h == 0x0f && low == 0x94) return operation::op_fx94_chip8elf;
+                    if(high == 0xff && low == 0xff) return operation::op_ffff_chip8elf;
+                }
+
+                if(opcode == 0x00e0) return operation::op_00e0;
+                if(opcode == 0x00ee) return operation::op_00ee;
+
+                switch(high_h){
+                    case 0x00: return operation::op_0nnn;
+                    case 0x01: return operation::op_1nnn;
+                    case 0x02: return operation::op_2nnn;
+                    case 0x03: return operation::op_3xnn;
+                    case 0x04: return operation::op_4xnn;
+                    case 0x05: return low_l == 0x00 ? operation::op_5xy0 : operation::unknown;
+                    case 0x06: return operation::op_6xnn;
+                    case 0x07: return operation::op_7xnn;
+                    case 0x08:
+                        switch(low_l){
+                            case 0x00: return operation::op_8xy0;
+                            case 0x01: return operation::op_8xy1;
+                            case 0x02: return operation::op_8xy2;
+                            case 0x03: return operation::op_8xy3;
+                            case 0x04: return operation::op_8xy4;
+                            case 0x05: return operation::op_8xy5;
+                            case 0x06: return operation::op_8xy6;
+                            case 0x07: return operation::op_8xy7;
+                            case 0x0e: return operation::op_8xye;
+                            default: return operation::unknown;
+                        }
+                    case 0x09: return low_l == 0x00 ? operation::op_9xy0 : operation::unknown;
+                    case 0x0a: return operation::op_annn;
+                    case 0x0b: return operation::op_bnnn;
+                    case 0x0c: return operation::op_cxnn;
+                    case 0x0d: return operation::op_dxyn;
+                    case 0x0e:
+                        if(low == 0x9e) return operation::op_ex9e;
+                        if(low == 0xa1) return operation::op_exa1;
+                        return operation::unknown;
+                    default:
+                        switch(low){
+                            case 0x07: return operation::op_fx07;
+                            case 0x0a: return operation::op_fx0a;
+                            case 0x15: return operation::op_fx15;
+                            case 0x18: return operation::op_fx18;
+                            case 0x1e: return operation::op_fx1e;
+                            case 0x29: return operation::op_fx29;
+                            case 0x33: return operation::op_fx33;
+                            case 0x55: return operation::op_fx55;
+                            case 0x65: return operation::op_fx65;
+                            default: return operation::unknown;
+                        }
+                }
+            }
+
+            /// decode an opcode and extract its operands
+            template<class iset> static instruction decode_instruction(const iset &s, uint16_t opcode){
+                return {
+                    s.table_decoder ? s.dispatch_table[opcode] : decode(s, opcode),
+                    static_cast<uint8_t>((opcode >> 8) & 0x0f),
+                    static_cast<uint8_t>((opcode >> 4) & 0x0f),
+                    static_cast<uint8_t>(opcode & 0x0f),
+                    static_cast<uint8_t>(opcode & 0xff),
+                    static_cast<uint16_t>(opcode & 0x0fff),
+                };
+            }
+
         public:
-            explicit chip8_instruction_set(lua_State *L){
-                lua_getfield(L, -1, "instruction_set");
-                if(lua_istable(L, -1)){
-                    lua_getfield(L, -1, "chip8e");
-                    chip8e = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "super_chip_1_0");
-                    super_chip_1_0 = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "super_chip_1_1");
-                    super_chip_1_1 = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "scroll_up_00bn");
-                    scroll_up_00bn = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "set_rd0_fxf2");
-                    set_rd0_fxf2 = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "chip8x");
-                    chip8x = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "xochip");
-                    xochip = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "stop_0000");
-                    stop_0000 = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "chip8run");
-                    chip8run = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "eti660");
-                    chip8run = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "eti660color");
-                    eti660color = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "eti660color_highres");
-                    eti660color_highres = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "chip8elf");
-                    chip8elf = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
+            /**
+             * @param flags the extensions as a combination of instruction_set_flags
+             * @param table_decoder build a dispatch table instead of decoding every opcode
+             */
+            chip8_instruction_set(uint32_t flags, bool table_decoder) : table_decoder(table_decoder){
+                chip8e = flags & instruction_set_flags::chip8e;
+                super_chip_1_0 = flags & instruction_set_flags::super_chip_1_0;
+                super_chip_1_1 = flags & instruction_set_flags::super_chip_1_1;
+                scroll_up_00bn = flags & instruction_set_flags::scroll_up_00bn;
+                set_rd0_fxf2 = flags & instruction_set_flags::set_rd0_fxf2;
+                chip8x = flags & instruction_set_flags::chip8x;
+                xochip = flags & instruction_set_flags::xochip;
+                stop_0000 = flags & instruction_set_flags::stop_0000;
+                chip8run = flags & instruction_set_flags::chip8run;
+                eti660 = flags & instruction_set_flags::eti660;
+                eti660color = flags & instruction_set_flags::eti660color;
+                eti660color_highres = flags & instruction_set_flags::eti660color_highres;
+                chip8elf = flags & instruction_set_flags::chip8elf;
+
+                // resolve every opcode once, so that execution needs a single lookup
+                if(table_decoder){
+                    dispatch_table.resize(0x10000);
+                    for(size_t opcode = 0; opcode < dispatch_table.size(); opcode++){
+                        dispatch_table[opcode] = decode(*this, opcode);
+                    }
                 }
-                lua_pop(L, 1);
+            }
+
+            /// returns the extensions as a combination of instruction_set_flags
+            uint32_t flags() const{
+                return (chip8e ? instruction_set_flags::chip8e : 0)
+                | (super_chip_1_0 ? instruction_set_flags::super_chip_1_0 : 0)
+                | (super_chip_1_1 ? instruction_set_flags::super_chip_1_1 : 0)
+                | (scroll_up_00bn ? instruction_set_flags::scroll_up_00bn : 0)
+                | (set_rd0_fxf2 ? instruction_set_flags::set_rd0_fxf2 : 0)
+                | (chip8x ? instruction_set_flags::chip8x : 0)
+                | (xochip ? instruction_set_flags::xochip : 0)
+                | (stop_0000 ? instruction_set_flags::stop_0000 : 0)
+                | (chip8run ? instruction_set_flags::chip8run : 0)
+                | (eti660 ? instruction_set_flags::eti660 : 0)
+                | (eti660color ? instruction_set_flags::eti660color : 0)
+                | (eti660color_highres ? instruction_set_flags::eti660color_highres : 0)
+                | (chip8elf ? instruction_set_flags::chip8elf : 0);
             }
 
             /// Print the instruction set to outstream
@@ -105,7 +346,42 @@ namespace chip8{
                 << "eti660                          " << (eti660 ? "true\n" : "false\n")
                 << "eti660color                     " << (eti660color ? "true\n" : "false\n")
                 << "eti660color_highres             " << (eti660color_highres ? "true\n" : "false\n")
-                << "chip8elf                        " << (chip8elf ? "true\n" : "false\n");
+                << "chip8elf                        " << (chip8elf ? "true\n" : "false\n")
+                << "decoder                         " << (table_decoder ? "table\n" : "cascade\n");
             }
     };
+
+    /** An instruction set that is known at compile time.
+    The static members hide the runtime members of chip8_instruction_set, so that the interpreter can drop the branches of disabled extensions.
+    The instruction set read from the mode must match (see flags()).
+    */
+    template<uint32_t extensions> class chip8_instruction_set_fixed : public chip8_instruction_set{
+        public:
+            static constexpr uint32_t fixed_flags = extensions;
+
+            static constexpr bool chip8e = extensions & instruction_set_flags::chip8e;
+            static constexpr bool super_chip_1_0 = extensions & instruction_set_flags::super_chip_1_0;
+            static constexpr bool super_chip_1_1 = extensions & instruction_set_flags::super_chip_1_1;
+            static constexpr bool scroll_up_00bn = extensions & instruction_set_flags::scroll_up_00bn;
+            static constexpr bool set_rd0_fxf2 = extensions & instruction_set_flags::set_rd0_fxf2;
+            static constexpr bool chip8x = extensions & instruction_set_flags::chip8x;
+            static constexpr bool xochip = extensions & instruction_set_flags::xochip;
+            static constexpr bool stop_0000 = extensions & instruction_set_flags::stop_0000;
+            static constexpr bool chip8run = extensions & instruction_set_flags::chip8run;
+            static constexpr bool eti660 = extensions & instruction_set_flags::eti660;
+            static constexpr bool eti660color = extensions & instruction_set_flags::eti660color;
+            static constexpr bool eti660color_highres = extensions & instruction_set_flags::eti660color_highres;
+            static constexpr bool chip8elf = extensions & instruction_set_flags::chip8elf;
+
+            chip8_instruction_set_fixed(uint32_t flags, bool table_decoder) : chip8_instruction_set(flags, table_decoder){}
+    };
+
+    using iset_chip8 = chip8_instruction_set_fixed<0>;
+    using iset_schip10 = chip8_instruction_set_fixed<instruction_set_flags::super_chip_1_0>;
+    using iset_schip11 = chip8_instruction_set_fixed<instruction_set_flags::super_chip_1_0 | instruction_set_flags::super_chip_1_1>;
+    using iset_chip8x = chip8_instruction_set_fixed<instruction_set_flags::chip8x>;
+    using iset_xochip = chip8_instruction_set_fixed<
+        instruction_set_flags::super_chip_1_0 | instruction_set_flags::super_chip_1_1 | instruction_set_flags::xochip>;
+    using iset_octo = chip8_instruction_set_fixed<
+        instruction_set_flags::super_chip_1_0 | instruction_set_flags::super_chip_1_1 | instruction_set_flags::xochip | instruction_set_flags::stop_0000>;
 }
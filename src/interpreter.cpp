@@ -1,9 +1,16 @@
+#include <cstddef>
+#include <cstring>
 #include <iomanip>
 #include <string>
+#include <tuple>
 #include <exception>
 #include <stdexcept>
 #include <cstdlib>
 #include <cmath>
+#include <memory>
+#include <span>
+#include <vector>
+#include <algorithm>
 
 extern "C"
 {
@@ -13,25 +20,294 @@ extern "C"
 }
 
 #include "instruction_set.cpp"
+#include "jit.cpp"
 #include "quirks.cpp"
+#include "mode.cpp"
 #include "hardware.cpp"
 #include "palette.cpp"
+#include "frontend.cpp"
 
 namespace chip8{
     template<class instruction_set, class quirks, class hardware> class chip8_interpreter : public hardware, public quirks, public instruction_set{
         protected:
             bool skip_instruction;
 
+            /// identifies the mode in save states
+            uint64_t mode_hash;
+
+            /// number of sprites drawn by dxyn since the start, for benchmarks
+            uint64_t sprites_drawn = 0;
+
+            struct save_state_header{
+                char magic[8];
+                uint32_t version;
+                /// bytes of machine_state that follow the header
+                uint32_t state_size;
+                uint64_t mode_hash;
+                // state of the interpreter outside of machine_state
+                uint32_t cycles_to_tick;
+                bool skip_instruction;
+                bool override_fx55_fx65_no_increment;
+            };
+            static constexpr char save_state_magic[8] = {'C', 'H', 'I', 'P', '8', 'S', 'A', 'V'};
+            /// increase on every change of save_state_header or machine_state
+            static constexpr uint32_t save_state_version = 2;
+
+            /// the memory beyond memory_size is left out
+            uint32_t save_state_size() const{
+                return offsetof(machine_state, memory) + hardware::memory_size;
+            }
+
+            /// Lua state of the mode for its callbacks, nullptr if the mode doesn't need one
             lua_State *L;
 
+            /// registry references to the functions of the mode, LUA_NOREF if it doesn't define one
+            int output_port_3_callback, input_port_3_wait_callback, input_port_3_callback, hex_display_callback;
+            /// values for output callbacks that haven't been passed to Lua yet
+            std::vector<std::pair<int, uint8_t>> pending_outputs;
+            /// outputs are passed to Lua at the end of a frame or when this many are pending
+            static constexpr size_t max_pending_outputs = 256;
+
+            /// returns a registry reference to the function name of the mode table at the top of the stack, LUA_NOREF without a Lua state
+            int reference_callback(const char *name){
+                if(!L) return LUA_NOREF;
+
+                lua_getfield(L, -1, name);
+                if(lua_isfunction(L, -1)){
+                    return luaL_ref(L, LUA_REGISTRYINDEX);
+                }
+                lua_pop(L, 1);
+                return LUA_NOREF;
+            }
+
+            /// call a referenced function with the arguments on the stack, errors are thrown as std::runtime_error
+            void call_callback(int reference, int arguments, int results){
+                lua_rawgeti(L, LUA_REGISTRYINDEX, reference);
+                lua_insert(L, -(arguments + 1));
+                if(lua_pcall(L, arguments, results, 0) != LUA_OK){
+                    std::string error = lua_isstring(L, -1) ? lua_tostring(L, -1) : "error in a callback of the mode";
+                    lua_pop(L, 1);
+                    throw std::runtime_error(error);
+                }
+            }
+
+            /// queue a value for an output callback
+            void queue_output(int reference, uint8_t value){
+                if(reference == LUA_NOREF) return;
+
+                pending_outputs.emplace_back(reference, value);
+                if(pending_outputs.size() >= max_pending_outputs) flush_outputs();
+            }
+
+            /// returns the value of an input callback, 0 if it isn't defined or doesn't return an integer
+            uint8_t read_input(int reference){
+                if(reference == LUA_NOREF) return 0;
+
+                // the input may depend on earlier outputs
+                flush_outputs();
+
+                call_callback(reference, 0, 1);
+                uint8_t value = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : 0;
+                lua_pop(L, 1);
+                return value;
+            }
+
+            /// a decoded basic block, it ends at the first instruction that may change the control flow
+            struct basic_block{
+                /// address of the first instruction and the address after the last instruction
+                size_t start, end;
+                /// false once memory inside the block has been written
+                bool valid = true;
+                /// the decoded instructions and their addresses
+                std::vector<std::pair<uint16_t, instruction>> instructions;
+                /// number of times the block was entered, until it is compiled
+                unsigned int executions = 0;
+                /// native code for the first native_count instructions
+                chip8_jit::native_function native = nullptr;
+                size_t native_count = 0;
+            };
+
+            /// maximum number of instructions in a basic block
+            static constexpr size_t max_block_instructions = 64;
+            /// maximum size of a basic block in bytes
+            static constexpr size_t max_block_size = max_block_instructions * 4;
+
+            /// execute whole basic blocks instead of single instructions
+            bool block_engine = false;
+            /// the cached basic blocks by start address
+            std::vector<std::shared_ptr<basic_block>> blocks;
+            /// number of cached basic blocks that contain each address
+            std::vector<uint16_t> block_coverage;
+
+            /// where the 60 Hz ticks of the delay and sound timers come from
+            enum class timer_source{
+                /// the host clock
+                clock,
+                /// every cycles_per_frame executed instructions
+                cycles,
+                /// every call to end_frame()
+                frames
+            };
+            timer_source timers = timer_source::clock;
+            /// instructions left until the next timer tick (timer_source::cycles)
+            unsigned int cycles_to_tick;
+
+            /// decrement the delay and sound timers
+            template<class frontend> void tick_timers(frontend &f){
+                if(hardware::sound_timer == 1) f.set_audio_state(false);
+                hardware::delay_timer = hardware::delay_timer > 0 ? hardware::delay_timer - 1 : 0;
+                hardware::sound_timer = hardware::sound_timer > 0 ? hardware::sound_timer - 1 : 0;
+            }
+
+            template<class frontend> void set_audio_frequency(frontend &f, double frequency){
+                hardware::audio_frequency = frequency;
+                f.set_audio_frequency(frequency);
+            }
+
+            /// account for executed instructions (timer_source::cycles)
+            void consume_cycles(unsigned int count){
+                if(timers == timer_source::cycles) cycles_to_tick -= count;
+            }
+
+            /// number of times a block is executed before it is compiled
+            static constexpr unsigned int jit_threshold = 16;
+            /// compiles hot blocks to native code, nullptr if disabled
+            std::unique_ptr<chip8_jit> jit;
+            /// execute every compiled block in the interpreter too and compare the results
+            bool jit_check = false;
+
+            /// compile the longest prefix of a block that the jit supports
+            void compile_block(basic_block &b){
+                std::vector<instruction> prefix;
+                for(const auto &[address, i] : b.instructions){
+                    if(!chip8_jit::can_compile(i.op)) break;
+                    prefix.push_back(i);
+                }
+
+                // a single instruction isn't worth a native call
+                if(prefix.size() < 2) return;
+
+                b.native = jit->compile(prefix, quirks::quirk_8xy6_8xye_shift_vx);
+                b.native_count = b.native ? prefix.size() : 0;
+            }
+
+            /// run the native code of a block, in check mode compare it to the interpreter
+            template<class frontend> void run_native(frontend &f, const basic_block &b){
+                if(!jit_check){
+                    b.native(hardware::registers.data(), &this->register_I);
+                    return;
+                }
+
+                std::array<uint8_t, 16> registers_before = hardware::registers;
+                uint16_t register_I_before = hardware::register_I;
+
+                b.native(hardware::registers.data(), &this->register_I);
+                std::array<uint8_t, 16> registers_native = hardware::registers;
+                uint16_t register_I_native = hardware::register_I;
+
+                hardware::registers = registers_before;
+                hardware::register_I = register_I_before;
+                for(size_t j = 0; j < b.native_count; j++){
+                    execute_instruction(f, b.instructions[j].second);
+                }
+
+                if(registers_native != hardware::registers || register_I_native != hardware::register_I){
+                    std::stringstream message;
+                    message << "native code differs from the interpreter in the block at " << std::hex << b.start;
+                    throw std::runtime_error(message.str());
+                }
+            }
+
+            /// write to memory and invalidate the cached basic blocks that contain the address
+            void write_memory(size_t address, uint8_t value){
+                hardware::memory_at(address) = value;
+
+                if(block_engine && block_coverage[address]){
+                    invalidate_blocks(address);
+                }
+            }
+
+            /// remove a basic block from the cache and free its native code
+            void remove_block(std::shared_ptr<basic_block> &b){
+                for(size_t address = b->start; address < b->end; address++){
+                    block_coverage[address]--;
+                }
+                if(b->native){
+                    jit->release(b->native);
+                    b->native = nullptr;
+                    b->native_count = 0;
+                }
+                b->valid = false;
+                b.reset();
+            }
+
+            /// remove all cached basic blocks that contain address
+            void invalidate_blocks(size_t address){
+                size_t first = address >= max_block_size ? address - max_block_size + 1 : 0;
+                for(size_t start = first; start <= address; start++){
+                    if(blocks[start] && address < blocks[start]->end){
+                        remove_block(blocks[start]);
+                    }
+                }
+            }
+
+            /// returns true for instructions that may change the control flow or stop the execution
+            static bool is_block_end(operation op){
+                switch(op){
+                    case operation::op_00ed_chip8e: case operation::op_0151_chip8e: case operation::op_0188_chip8e:
+                    case operation::op_5xy1_chip8e: case operation::op_bbnn_chip8e: case operation::op_bfnn_chip8e:
+                    case operation::op_fx1b_chip8e: case operation::op_fx4f_chip8e:
+                    case operation::op_00fd_schip10:
+                    case operation::op_exf2_chip8x: case operation::op_exf5_chip8x: case operation::op_fxfb_chip8x:
+                    case operation::op_0000: case operation::op_001n_chip8run:
+                    case operation::op_5xy1_chip8elf: case operation::op_5xy2_chip8elf: case operation::op_5xy3_chip8elf:
+                    case operation::op_ffff_chip8elf:
+                    case operation::op_00ee: case operation::op_0nnn: case operation::op_1nnn: case operation::op_2nnn:
+                    case operation::op_3xnn: case operation::op_4xnn: case operation::op_5xy0: case operation::op_9xy0:
+                    case operation::op_bnnn: case operation::op_dxyn: case operation::op_ex9e: case operation::op_exa1:
+                    case operation::op_fx0a: case operation::unknown:
+                        return true;
+                    default:
+                        return false;
+                }
+            }
+
+            /// decode the basic block starting at start and add it to the cache
+            std::shared_ptr<basic_block> build_block(size_t start){
+                std::shared_ptr<basic_block> b = std::make_shared<basic_block>();
+                b->start = start;
+
+                size_t address = start;
+                while(b->instructions.size() < max_block_instructions && address + 1 < hardware::memory_size){
+                    uint16_t opcode = (hardware::memory[address] << 8) | hardware::memory[address + 1];
+                    instruction i = instruction_set::decode_instruction(static_cast<const instruction_set &>(*this), opcode);
+                    b->instructions.push_back({address, i});
+
+                    // f000 nnnn is followed by a 16 bit address
+                    address += i.op == operation::op_f000_xochip ? 4 : 2;
+
+                    if(is_block_end(i.op)) break;
+                }
+                b->end = std::min(address, hardware::memory_size);
+
+                if(!b->instructions.empty()){
+                    for(address = b->start; address < b->end; address++){
+                        block_coverage[address]++;
+                    }
+                    blocks[start] = b;
+                }
+
+                return b;
+            }
+
             void bcd_of_v(uint8_t x){
                 std::stringstream s_stream;
                 s_stream << std::setw(3) << std::setfill('0') << std::dec << (int)hardware::registers.at(x);
                 std::string str = s_stream.str();
 
-                hardware::memory.at(hardware::register_I) = std::stoi(str.substr(0, 1));
-                hardware::memory.at(hardware::register_I + 1) = std::stoi(str.substr(1, 1));
-                hardware::memory.at(hardware::register_I + 2) = std::stoi(str.substr(2, 1));
+                write_memory(hardware::register_I, std::stoi(str.substr(0, 1)));
+                write_memory(hardware::register_I + 1, std::stoi(str.substr(1, 1)));
+                write_memory(hardware::register_I + 2, std::stoi(str.substr(2, 1)));
             }
 
             void bcd_16_bit(uint16_t x){
@@ -39,28 +315,37 @@ namespace chip8{
                 s_stream << std::setw(5) << std::setfill('0') << std::dec << (int)x;
                 std::string str = s_stream.str();
 
-                hardware::memory.at(hardware::register_I) = std::stoi(str.substr(0, 1));
-                hardware::memory.at(hardware::register_I + 1) = std::stoi(str.substr(1, 1));
-                hardware::memory.at(hardware::register_I + 2) = std::stoi(str.substr(2, 1));
-                hardware::memory.at(hardware::register_I + 3) = std::stoi(str.substr(3, 1));
-                hardware::memory.at(hardware::register_I + 4) = std::stoi(str.substr(4, 1));
+                write_memory(hardware::register_I, std::stoi(str.substr(0, 1)));
+                write_memory(hardware::register_I + 1, std::stoi(str.substr(1, 1)));
+                write_memory(hardware::register_I + 2, std::stoi(str.substr(2, 1)));
+                write_memory(hardware::register_I + 3, std::stoi(str.substr(3, 1)));
+                write_memory(hardware::register_I + 4, std::stoi(str.substr(4, 1)));
             }
 
-            /// draw a pixel
-            template<class frontend> void draw_pixel(frontend &f, int plane, int x, int y){
-                hardware::screen_set(plane, x, y, hardware::screen_get(plane, x, y) ^ 0x01, f);
+            /// returns a sprite byte with every pixel doubled
+            static uint16_t double_pixels(uint8_t byte){
+                uint16_t pixels = 0;
+                for(unsigned int column = 0; column < 8; column++){
+                    if((byte << column) & 0x80) pixels |= 0xc000 >> (column * 2);
+                }
+                return pixels;
+            }
 
-                if(!hardware::screen_get(plane, x, y)){
-                    if(hardware::high_res && quirks::quirk_dxyn_count_collisions_highres){
-                        hardware::registers.at(0xf)++;
-                    }else{
-                        hardware::registers.at(0xf) = 0x01;
-                    }
+            /// xor a sprite row into the screen row y, wrapping or clipping at the right border
+            unsigned int draw_sprite_row(unsigned int plane, unsigned int x, unsigned int y, uint64_t bits, unsigned int width){
+                unsigned int collisions = hardware::screen_xor(plane, x, y, bits, width);
+
+                if(!quirks::quirk_dxyn_no_wrapping && x + width > hardware::screen_x){
+                    collisions += hardware::screen_xor(plane, 0, y, bits << (hardware::screen_x - x), width - (hardware::screen_x - x));
                 }
+
+                return collisions;
             }
 
             /// draw a sprite
-            template<class frontend> void draw(frontend &f, uint8_t opcode_x, uint8_t opcode_y, uint8_t opcode_n){
+            void draw(uint8_t opcode_x, uint8_t opcode_y, uint8_t opcode_n){
+                sprites_drawn++;
+
                 // number of rows in the sprite
                 const unsigned int rows = [=,this]{
                     if(opcode_n == 0 && quirks::quirk_dxy0_16x16_highres && hardware::high_res){ // 16x16 sprite
@@ -103,7 +388,7 @@ namespace chip8{
                 hardware::registers.at(0xf) = 0x00;
 
                 for(unsigned int plane = 0; plane < hardware::screen_planes; plane++){
-                    if(!hardware::active_screen_planes.at(plane)) continue;
+                    if(!hardware::plane_active(plane)) continue;
 
                     unsigned int y = quirks::quirk_dxyn_no_wrapping ? sprite_y : sprite_y % hardware::screen_y;
 
@@ -113,20 +398,26 @@ namespace chip8{
                         unsigned int x = quirks::quirk_dxyn_no_wrapping ? sprite_x : sprite_x % hardware::screen_x;
 
                         for(unsigned int byte = 0; byte < bytes_per_row; byte++){
-                            for(unsigned int column = 0; column < 8; column++){
-                                if(x >= hardware::screen_x) break;
-
-                                if((hardware::memory.at(sprite_index) << column) & 0x80){
-                                    draw_pixel(f, plane, x, y);
+                            if(x < hardware::screen_x){
+                                // one byte of the sprite as a left aligned row of pixels
+                                unsigned int width = 8 * stride;
+                                uint64_t bits = scale_up ? double_pixels(hardware::memory_at(sprite_index)) : hardware::memory_at(sprite_index);
+                                bits <<= 64 - width;
+
+                                unsigned int collisions = draw_sprite_row(plane, x, y, bits, width);
+                                if(scale_up){
+                                    collisions += draw_sprite_row(plane, x, y + 1, bits, width);
+                                }
 
-                                    if(scale_up){
-                                        draw_pixel(f, plane, x + 1, y);
-                                        draw_pixel(f, plane, x, y + 1);
-                                        draw_pixel(f, plane, x + 1, y + 1);
+                                if(collisions){
+                                    if(hardware::high_res && quirks::quirk_dxyn_count_collisions_highres){
+                                        hardware::registers.at(0xf) += collisions;
+                                    }else{
+                                        hardware::registers.at(0xf) = 0x01;
                                     }
                                 }
 
-                                x += stride;
+                                x += width;
                                 x = quirks::quirk_dxyn_no_wrapping ? x : x % hardware::screen_x;
                             }
 
@@ -142,19 +433,18 @@ namespace chip8{
             /**
              * @brief clear the screen
              *
-             * @tparam frontend
-             * @param f frontend
              * @param force_all_planes if true, clear inactive planes
              */
-            template<class frontend> void clear_screen(frontend &f, bool force_all_planes=false){
+            void clear_screen(bool force_all_planes=false){
                 for(unsigned int plane = 0; plane < hardware::screen_planes; plane++){
-                    if(!hardware::active_screen_planes.at(plane) && !force_all_planes) continue;
+                    if(!hardware::plane_active(plane) && !force_all_planes) continue;
                     
-                    for(unsigned int x = 0; x < hardware::screen_x; x++){
-                        for(unsigned int y = 0; y < hardware::screen_y; y++){
-                            if(hardware::screen_content.at(plane).at(y).at(x)){
-                                hardware::screen_content.at(plane).at(y).at(x) = 0x00;
-                                f.draw(x, y, hardware::palette.color(this, x, y));
+                    for(unsigned int y = 0; y < hardware::screen_y; y++){
+                        uint64_t *row = hardware::screen_row(plane, y);
+                        for(unsigned int word = 0; word < hardware::screen_words; word++){
+                            if(row[word]){
+                                row[word] = 0;
+                                hardware::screen_damage_rect(word * 64, y, 64, 1);
                             }
                         }
                     }
@@ -162,183 +452,119 @@ namespace chip8{
             }
 
             /**
-             * @brief scroll up n pixels
+             * @brief scroll the active planes
+             *
+             * The frontend is told to move its image if that gives the same result as redrawing,
+             * otherwise the whole screen is marked as changed.
              *
              * @tparam frontend
              * @param f frontend
-             * @param n amount of pixels to scroll
+             * @param dx pixels to scroll right (negative: left)
+             * @param dy pixels to scroll down (negative: up)
              */
-            template<class frontend> void scroll_up(frontend &f, unsigned int n){
+            template<class frontend> void scroll(frontend &f, int dx, int dy){
+                // the image moves as a whole if every plane with content is scrolled and colors only depend on the planes
+                bool move_image = !hardware::palette.position_dependent();
+
                 for(unsigned int plane = 0; plane < hardware::screen_planes; plane++){
-                    if(!hardware::active_screen_planes.at(plane)) continue;
+                    if(!hardware::plane_active(plane) && !hardware::screen_plane_empty(plane)){
+                        move_image = false;
+                    }
+                }
 
-                    for(unsigned int y = 0 ; y < hardware::screen_y - n;  y++){
-                        hardware::screen_content.at(plane).at(y) = hardware::screen_content.at(plane).at(y + n);
+                // the frontend image has to be up to date before it is moved
+                if(move_image) present(f);
 
-                        for(unsigned int x = 0; x < hardware::screen_x; x++){
-                            f.draw(x, y, hardware::palette.color(this, x, y));
-                        }
-                    }
-                    for(unsigned int y = hardware::screen_y - n; y < hardware::screen_y; y++){
-                        for(unsigned int x = 0; x < hardware::screen_content.at(plane).at(y).size(); x++){
-                            hardware::screen_content.at(plane).at(y).at(x) = 0x00;
-                        }
-                        for(unsigned int x = 0; x < hardware::screen_x; x++){
-                            f.draw(x, y, hardware::palette.color(this, x, y));
-                        }
+                for(unsigned int plane = 0; plane < hardware::screen_planes; plane++){
+                    if(hardware::plane_active(plane)){
+                        hardware::screen_shift(plane, dx, dy);
                     }
                 }
+
+                if(move_image){
+                    f.scroll(dx, dy, hardware::palette.bg_color(this));
+                }else{
+                    hardware::screen_damage_all();
+                }
             }
 
             /**
-             * @brief scroll down n pixels
+             * @brief scroll up n pixels
              *
              * @tparam frontend
              * @param f frontend
              * @param n amount of pixels to scroll
              */
-            template<class frontend> void scroll_down(frontend &f, unsigned int n){
-                for(unsigned int plane = 0; plane < hardware::screen_planes; plane++){
-                    if(!hardware::active_screen_planes.at(plane)) continue;
-
-                    for(unsigned int y = hardware::screen_y - 1 ; y >= n;  y--){
-                        hardware::screen_content.at(plane).at(y) = hardware::screen_content.at(plane).at(y - n);
-                        
-                        for(unsigned int x = 0; x < hardware::screen_x; x++){
-                            f.draw(x, y, hardware::palette.color(this, x, y));
-                        }
-                    }
-                    for(unsigned int y = 0; y < n; y++){
-                        for(unsigned int x = 0; x < hardware::screen_content.at(plane).at(y).size(); x++){
-                            hardware::screen_content.at(plane).at(y).at(x) = 0x00;
-                        }
-                        for(unsigned int x = 0; x < hardware::screen_x; x++){
-                            f.draw(x, y, hardware::palette.color(this, x, y));
-                        }
-                    }
-                }
+            template<class frontend> void scroll_up(frontend &f, unsigned int n){
+                scroll(f, 0, -static_cast<int>(n));
             }
 
             /**
-             * @brief scroll right 4 pixels
+             * @brief scroll down n pixels
              *
              * @tparam frontend
              * @param f frontend
+             * @param n amount of pixels to scroll
              */
-            template<class frontend> void scroll_right(frontend &f){
-                for(unsigned int plane = 0; plane < hardware::screen_planes; plane++){
-                    if(!hardware::active_screen_planes.at(plane)) continue;
-
-                    for(unsigned int y = 0; y < hardware::screen_y; y++){
-                        int x = hardware::screen_x - 5;
-                        while(x >= 0){
-                            hardware::screen_content.at(plane).at(y).at(x + 4) = hardware::screen_content.at(plane).at(y).at(x);
-                            f.draw(x + 4, y, hardware::palette.color(this, x + 4, y));
-                            x--;
-                        }
-
-                        hardware::screen_content.at(plane).at(y).at(0) = 0x00;
-                        hardware::screen_content.at(plane).at(y).at(1) = 0x00;
-                        hardware::screen_content.at(plane).at(y).at(2) = 0x00;
-                        hardware::screen_content.at(plane).at(y).at(3) = 0x00;
-                        f.draw(0, y, hardware::palette.color(this, 0, y));
-                        f.draw(1, y, hardware::palette.color(this, 1, y));
-                        f.draw(2, y, hardware::palette.color(this, 2, y));
-                        f.draw(3, y, hardware::palette.color(this, 3, y));
-                    }
-                }
+            template<class frontend> void scroll_down(frontend &f, unsigned int n){
+                scroll(f, 0, n);
             }
 
             /**
-             * @brief scroll left 4 pixels
+             * @brief scroll right n pixels
              *
              * @tparam frontend
              * @param f frontend
+             * @param n amount of pixels to scroll
              */
-            template<class frontend> void scroll_left(frontend &f){
-                for(unsigned int plane = 0; plane < hardware::screen_planes; plane++){
-                    if(!hardware::active_screen_planes.at(plane)) continue;
-
-                    for(unsigned int y = 0; y < hardware::screen_y; y++){
-                        unsigned int x = 4;
-                        while(x < hardware::screen_x){
-                            hardware::screen_content.at(plane).at(y).at(x - 4) = hardware::screen_content.at(plane).at(y).at(x);
-                            f.draw(x - 4, y, hardware::palette.color(this, x - 4, y));
-                            x++;
-                        }
-
-                        hardware::screen_content.at(plane).at(y).at(x - 4) = 0x00;
-                        hardware::screen_content.at(plane).at(y).at(x - 3) = 0x00;
-                        hardware::screen_content.at(plane).at(y).at(x - 2) = 0x00;
-                        hardware::screen_content.at(plane).at(y).at(x - 1) = 0x00;
-                        f.draw(x - 4, y, hardware::palette.color(this, x - 4, y));
-                        f.draw(x - 3, y, hardware::palette.color(this, x - 3, y));
-                        f.draw(x - 2, y, hardware::palette.color(this, x - 2, y));
-                        f.draw(x - 1, y, hardware::palette.color(this, x - 1, y));
-                    }
-                }
+            template<class frontend> void scroll_right(frontend &f, unsigned int n){
+                scroll(f, n, 0);
             }
 
             /**
-             * @brief changes the background color (CHIP-8X, ETI-660 color)
+             * @brief scroll left n pixels
              *
              * @tparam frontend
              * @param f frontend
+             * @param n amount of pixels to scroll
              */
-            template<class frontend> void step_bg_color(frontend &f){
-                hardware::screen_bg_color = (hardware::screen_bg_color + 1) % 4;
-                for(unsigned int y = 0; y < hardware::screen_y; y++){
-                    for(unsigned int x = 0; x < hardware::screen_x; x++){
-                        if(!hardware::screen_get(0, x, y)) f.draw(x, y, hardware::palette.color(this, x, y));
-                    }
-                }
-            }
-        
-        public:
-            explicit chip8_interpreter(lua_State *L) : hardware(L), quirks(L), instruction_set(L){
-                skip_instruction = false;
-
-                this->L = L;
-            }
-
-            template<class frontend> void frontend_init(frontend &f){
-                f.clear(hardware::palette.bg_color(this));
+            template<class frontend> void scroll_left(frontend &f, unsigned int n){
+                scroll(f, -static_cast<int>(n), 0);
             }
 
-            void print(std::ostream &outstream){
-                outstream << "hardware:\n";
-                hardware::print(outstream);
-
-                outstream << "\ninstruction set:\n";
-                instruction_set::print(outstream);
-
-                outstream << "\nquirks:\n";
-                quirks::print(outstream);
+            /**
+             * @brief changes the background color (CHIP-8X, ETI-660 color)
+             */
+            void step_bg_color(){
+                hardware::screen_bg_color = (hardware::screen_bg_color + 1) % 4;
+                hardware::screen_damage_all();
             }
 
-            /// execute one instruction at pc and increment pc
-            template<class frontend> int execute(frontend &f){
-                int return_value = 1;
-                bool matched_opcode;
-
+            /**
+             * @brief update the timers and handle waiting and skipping before an instruction
+             *
+             * @return false if no instruction should be executed in this cycle
+             */
+            template<class frontend> bool prepare_instruction(frontend &f){
                 // decrement timers
-                std::chrono::time_point<std::chrono::steady_clock> timer_now = std::chrono::steady_clock::now();
-                if(std::chrono::duration_cast<std::chrono::microseconds>(timer_now - hardware::timer_start).count() >= hardware::timer_delay){
-                    hardware::timer_start = timer_now;
-                    if(hardware::sound_timer == 1) f.set_audio_state(false);
-                    hardware::delay_timer = hardware::delay_timer > 0 ? hardware::delay_timer - 1 : 0;
-                    hardware::sound_timer = hardware::sound_timer > 0 ? hardware::sound_timer - 1 : 0;
+                if(timers == timer_source::clock){
+                    std::chrono::time_point<std::chrono::steady_clock> timer_now = std::chrono::steady_clock::now();
+                    if(std::chrono::duration_cast<std::chrono::microseconds>(timer_now - hardware::timer_start).count() >= hardware::timer_delay){
+                        hardware::timer_start = timer_now;
+                        tick_timers(f);
+                    }
+                }else if(timers == timer_source::cycles && cycles_to_tick == 0){
+                    cycles_to_tick = hardware::cycles_per_frame;
+                    tick_timers(f);
                 }
 
                 // do nothing if we are waiting for a keypress (on keyboard 1)
                 if(hardware::waiting_for_key >= 0){
                     int key = -1;
-                    for(unsigned int i = 0; i < hardware::keyboard_1.size(); i++){
-                        if(hardware::keyboard_1.at(i)) key = i;
-                    }
+                    if(hardware::keyboard_1) key = 15 - std::countl_zero(hardware::keyboard_1);
                     
                     if(key < 0){
-                        return return_value;
+                        return false;
                     }else{
                         hardware::registers.at(hardware::waiting_for_key) = key;
                         hardware::waiting_for_key = -1;
@@ -347,7 +573,7 @@ namespace chip8{
 
                 // or waiting for the timer to reach 0
                 if(hardware::waiting_for_timer && hardware::delay_timer > 0x00){
-                    return return_value;
+                    return false;
                 }else if(hardware::waiting_for_timer){
                     hardware::waiting_for_timer = false;
                 }
@@ -358,12 +584,12 @@ namespace chip8{
 
                     // 32 bit instruction?
                     if(instruction_set::xochip){
-                        if(hardware::memory.at(hardware::pc) == 0xf0 && hardware::memory.at(hardware::pc + 1) == 0x00){
+                        if(hardware::memory_at(hardware::pc) == 0xf0 && hardware::memory_at(hardware::pc + 1) == 0x00){
                             hardware::pc += 2;
                         }
                     }
                     if(instruction_set::chip8elf){
-                        if(hardware::memory.at(hardware::pc) == 0xff && hardware::memory.at(hardware::pc + 1) == 0xff){
+                        if(hardware::memory_at(hardware::pc) == 0xff && hardware::memory_at(hardware::pc + 1) == 0xff){
                             hardware::pc += 2;
                         }
                     }
@@ -371,235 +597,547 @@ namespace chip8{
                     hardware::pc += 2;
                 }
 
+                return true;
+            }
+        
+        public:
+            /**
+             * @param m the settings of the mode
+             * @param L the Lua state with the mode table at the top of the stack, only needed for the callbacks of the mode
+             */
+            chip8_interpreter(const mode_config &m, lua_State *L) :
+                hardware(m), quirks(m.quirk_flags), instruction_set(m.instruction_set_flags, m.table_decoder){
+                skip_instruction = false;
+                mode_hash = m.hash();
+
+                this->L = L;
+
+                output_port_3_callback = reference_callback("output_port_3");
+                input_port_3_wait_callback = reference_callback("input_port_3_wait");
+                input_port_3_callback = reference_callback("input_port_3");
+                hex_display_callback = reference_callback("hex_display");
+
+                if(m.timers == "cycles"){
+                    timers = timer_source::cycles;
+                }else if(m.timers == "frames"){
+                    timers = timer_source::frames;
+                }
+                cycles_to_tick = hardware::cycles_per_frame;
+
+                block_engine = m.block_engine;
+
+                // the jit compiles basic blocks, so it needs the block engine
+                jit_check = m.jit_check;
+                if(m.jit){
+                    block_engine = true;
+                    if(chip8_jit::available) jit = std::make_unique<chip8_jit>();
+                }
+
+                if(block_engine){
+                    blocks.resize(hardware::memory_size);
+                    block_coverage.resize(hardware::memory_size, 0);
+                }
+            }
+
+            /// read the mode table at the top of the stack
+            explicit chip8_interpreter(lua_State *L) : chip8_interpreter(mode_config(L), L){}
+
+            /**
+             * @brief start over without a program, e.g. to reuse the interpreter for the next program
+             *
+             * The Lua state of the mode isn't reset.
+             * @param m the mode the interpreter was created with
+             */
+            void reset(const mode_config &m){
+                hardware::reset(m);
+                skip_instruction = false;
+                quirks::override_fx55_fx65_no_increment = false;
+                cycles_to_tick = hardware::cycles_per_frame;
+                pending_outputs.clear();
+                sprites_drawn = 0;
+
+                // also frees the native code of the old program
+                if(block_engine) flush_blocks();
+            }
+
+            ~chip8_interpreter(){
+                if(!L) return;
+                for(int reference : {output_port_3_callback, input_port_3_wait_callback, input_port_3_callback, hex_display_callback}){
+                    luaL_unref(L, LUA_REGISTRYINDEX, reference);
+                }
+            }
+
+            template<chip8_frontend frontend> void frontend_init(frontend &f){
+                f.clear(hardware::palette.bg_color(this));
+                hardware::screen_damage_all();
+                present(f);
+            }
+
+            /**
+             * @brief draw everything that changed on the screen since the last call
+             *
+             * Changes are collected in tiles and sent as filled rectangles or rows, which keeps the output small
+             * for frontends where it is expensive, e.g. terminals over a network.
+             * Call it once per frame before refreshing the frontend.
+             *
+             * @tparam frontend
+             * @param f frontend
+             */
+            template<chip8_frontend frontend> void present(frontend &f){
+                std::vector<std::array<uint8_t, 3>> colors(hardware::screen_x);
+
+                hardware::screen_take_damage([&](size_t x0, size_t y0, size_t width, size_t height){
+                    // consecutive rows of a single color are filled as one rectangle
+                    size_t fill_start = 0;
+                    std::array<uint8_t, 3> fill_color;
+                    bool filling = false;
+
+                    for(size_t y = y0; y < y0 + height; y++){
+                        hardware::palette.convert_row(this, x0, y, width, colors.data());
+                        bool uniform = std::all_of(colors.begin() + 1, colors.begin() + width, [&](const std::array<uint8_t, 3> &c){ return c == colors[0]; });
+
+                        if(filling && !(uniform && colors[0] == fill_color)){
+                            f.fill_rect(x0, fill_start, width, y - fill_start, fill_color);
+                            filling = false;
+                        }
+
+                        if(!uniform){
+                            f.blit_row(x0, y, width, colors.data());
+                        }else if(!filling){
+                            fill_start = y;
+                            fill_color = colors[0];
+                            filling = true;
+                        }
+                    }
+
+                    if(filling){
+                        f.fill_rect(x0, fill_start, width, y0 + height - fill_start, fill_color);
+                    }
+                });
+            }
+
+            void print(std::ostream &outstream){
+                outstream << "hardware:\n";
+                hardware::print(outstream);
+
+                outstream << "\ninstruction set:\n";
+                instruction_set::print(outstream);
+
+                outstream << "\nquirks:\n";
+                quirks::print(outstream);
+            }
+
+            /// execute one instruction at pc and increment pc
+            template<chip8_frontend frontend> int execute(frontend &f){
+                int return_value = prepare_instruction(f) ? execute_next(f) : 1;
+                consume_cycles(1);
+
+                return return_value;
+            }
+
+            /**
+             * @brief execute the basic block at pc
+             *
+             * Timers, waiting and skipping are handled once before the block,
+             * the block is left early if an instruction changes pc or writes into the block.
+             *
+             * @param count set to the number of cycles used
+             * @param budget most cycles the block may use, at least 1
+             * @return 0 if the program stopped
+             */
+            template<chip8_frontend frontend> int execute_block(frontend &f, unsigned int &count, unsigned int budget){
+                try{
+                    int return_value = run_block(f, count, budget);
+                    consume_cycles(count);
+
+                    return return_value;
+                }catch(...){
+                    // the instructions before the failed one have been executed, none if the check of native code failed
+                    consume_cycles(count ? count - 1 : 0);
+                    throw;
+                }
+            }
+
+            /**
+             * @brief execute one instruction or one basic block, depending on the engine of the mode
+             *
+             * @param count set to the number of cycles used
+             * @param budget most cycles to use, at least 1, e.g. the rest of the frame
+             * @return 0 if the program stopped
+             */
+            template<chip8_frontend frontend> int step(frontend &f, unsigned int &count, unsigned int budget){
+                if(block_engine) return execute_block(f, count, budget);
+
+                count = 1;
+                return execute(f);
+            }
+
+            uint64_t get_sprites_drawn() const{
+                return sprites_drawn;
+            }
+
+            /// called by the main loop after every frame
+            template<chip8_frontend frontend> void end_frame(frontend &f){
+                if(timers == timer_source::frames) tick_timers(f);
+                flush_outputs();
+            }
+
+            /// pass the queued outputs to the callbacks of the mode
+            void flush_outputs(){
+                std::vector<std::pair<int, uint8_t>> outputs;
+                outputs.swap(pending_outputs);
+
+                for(const auto &[reference, value] : outputs){
+                    lua_pushinteger(L, value);
+                    call_callback(reference, 1, 0);
+                }
+            }
+
+            /// remove all cached basic blocks
+            void flush_blocks(){
+                for(std::shared_ptr<basic_block> &b : blocks){
+                    if(b) remove_block(b);
+                }
+            }
+
+            /**
+             * @brief write the complete state of the machine into a save state
+             *
+             * A save state is a header followed by the machine_state up to the used part of the memory.
+             * It can only be loaded into the mode it was saved in, on a machine with the same byte order.
+             * @param out receives the save state, its capacity is reused
+             */
+            void save_state(std::vector<uint8_t> &out) const{
+                std::span<const uint8_t> state = save_state_view(out);
+                out.resize(out.size() + state.size());
+                std::memcpy(out.data() + out.size() - state.size(), state.data(), state.size());
+            }
+
+            /**
+             * @brief a save state in two parts, without copying the machine
+             *
+             * @param header receives the header of the save state
+             * @return the machine_state that follows the header, it changes with the machine
+             */
+            std::span<const uint8_t> save_state_view(std::vector<uint8_t> &header) const{
+                save_state_header h{};
+                std::memcpy(h.magic, save_state_magic, sizeof(h.magic));
+                h.version = save_state_version;
+                h.state_size = save_state_size();
+                h.mode_hash = mode_hash;
+                h.cycles_to_tick = cycles_to_tick;
+                h.skip_instruction = skip_instruction;
+                h.override_fx55_fx65_no_increment = quirks::override_fx55_fx65_no_increment;
+
+                header.resize(sizeof(h));
+                std::memcpy(header.data(), &h, sizeof(h));
+                return {reinterpret_cast<const uint8_t *>(static_cast<const machine_state *>(this)), h.state_size};
+            }
+
+            /**
+             * @brief replace the state of the machine with a save state
+             *
+             * The frontend gets the audio settings of the save state, the screen is drawn by the next present().
+             * @throw std::runtime_error if the save state is damaged or from another mode or version
+             */
+            template<chip8_frontend frontend> void load_state(frontend &f, const std::vector<uint8_t> &in){
+                save_state_header header;
+                if(in.size() < sizeof(header)){
+                    throw std::runtime_error("save state is too short");
+                }
+                std::memcpy(&header, in.data(), sizeof(header));
+
+                if(std::memcmp(header.magic, save_state_magic, sizeof(header.magic)) != 0 || header.version != save_state_version){
+                    throw std::runtime_error("unsupported save state version");
+                }
+                if(header.mode_hash != mode_hash){
+                    throw std::runtime_error("save state is from another mode");
+                }
+                if(header.state_size != save_state_size() || in.size() != sizeof(header) + header.state_size){
+                    throw std::runtime_error("save state has the wrong size");
+                }
+
+                machine_state &state = *this;
+                uint16_t depth;
+                std::memcpy(&depth, in.data() + sizeof(header) + offsetof(machine_state, call_stack_depth), sizeof(depth));
+                if(depth > machine_state::call_stack_size){
+                    throw std::runtime_error("save state has an invalid call stack");
+                }
+                std::memcpy(&state, in.data() + sizeof(header), header.state_size);
+
+                cycles_to_tick = header.cycles_to_tick;
+                skip_instruction = header.skip_instruction;
+                quirks::override_fx55_fx65_no_increment = header.override_fx55_fx65_no_increment;
+                hardware::timer_start = std::chrono::steady_clock::now();
+
+                // the cached blocks were decoded from the old memory
+                if(block_engine) flush_blocks();
+
+                f.set_draw_disabled(hardware::draw_disabled);
+                hardware::screen_damage_all();
+
+                f.set_audio_frequency(hardware::audio_frequency);
+                f.set_audio_pattern(hardware::audio_pattern);
+                f.set_audio_state(hardware::sound_timer > 0);
+            }
+
+        protected:
+            /// execute a basic block without counting the cycles, see execute_block()
+            template<class frontend> int run_block(frontend &f, unsigned int &count, unsigned int budget){
+                count = 1;
+                if(!prepare_instruction(f)) return 1;
+
+                if(hardware::pc >= blocks.size()) return execute_next(f);
+
+                std::shared_ptr<basic_block> b = blocks[hardware::pc];
+                if(!b){
+                    b = build_block(hardware::pc);
+                    if(b->instructions.empty()) return execute_next(f);
+                }
+
+                // in cycle timer mode a block ends at the next timer tick, and never runs past the budget of the caller
+                unsigned int limit = timers == timer_source::cycles ? cycles_to_tick : max_block_instructions;
+                limit = std::max(1u, std::min(limit, budget));
+
+                size_t index = 0;
+                count = 0;
+                if(jit){
+                    if(b->executions < jit_threshold && ++b->executions == jit_threshold){
+                        compile_block(*b);
+                    }
+
+                    // the compiled instructions only change registers, so the block is still valid afterwards
+                    if(b->native && b->native_count <= limit){
+                        run_native(f, *b);
+                        index = b->native_count;
+                        count = index;
+                        hardware::pc = b->instructions[index - 1].first + 2;
+                    }
+                }
+
+                int return_value = 1;
+                for(; index < b->instructions.size(); index++){
+                    const auto &[address, i] = b->instructions[index];
+                    if(count > 0 && (hardware::pc != address || !b->valid || count >= limit)) break;
+
+                    hardware::pc = address + 2;
+                    count++;
+
+                    return_value = execute_instruction(f, i);
+                    if(!return_value || skip_instruction || hardware::waiting_for_key >= 0 || hardware::waiting_for_timer) break;
+                }
+
+                return return_value;
+            }
+
+        public:
+            /// fetch, decode and execute the instruction at pc
+            template<class frontend> int execute_next(frontend &f){
                 // get opcode from memory
-                uint8_t high = hardware::memory.at(hardware::pc), low = hardware::memory.at(hardware::pc + 1);
-                uint8_t high_h = (high >> 4), high_l = high & 0x0f, low_h = low >> 4, low_l = low & 0x0f;
-                uint16_t opcode = (high << 8) | low;
+                uint16_t opcode = (hardware::memory_at(hardware::pc) << 8) | hardware::memory_at(hardware::pc + 1);
 
                 // increment pc
                 hardware::pc += 2;
 
-                // decode opcode
-                if(instruction_set::chip8e){
-                    matched_opcode = true;
+                return execute_instruction(f, instruction_set::decode_instruction(static_cast<const instruction_set &>(*this), opcode));
+            }
+
+            /// execute a decoded instruction, pc must already point to the next instruction
+            template<class frontend> int execute_instruction(frontend &f, const instruction &i){
+                int return_value = 1;
 
+                switch(i.op){
                     // 00ed - stop execution (CHIP-8E)
-                    if(opcode == 0x00ed){
+                    case operation::op_00ed_chip8e:
                         return_value = 0;
+                        break;
 
                     // 00f2 - no operation (CHIP-8E)
-                    }else if(opcode == 0x00f2){
+                    case operation::op_00f2_chip8e:
+                        break;
 
                     // 0151 - wait until the delay timer reaches 0 (CHIP-8E)
-                    }else if(opcode == 0x0151){
+                    case operation::op_0151_chip8e:
                         hardware::waiting_for_timer = true;
-                    
+                        break;
+
                     // 0188 - skip the next instruction (CHIP-8E)
-                    }else if(opcode == 0x0188){
+                    case operation::op_0188_chip8e:
                         skip_instruction = true;
-                    
+                        break;
+
                     // 5xy1 - skip if Vx > Vy (CHIP-8E)
-                    }else if(high_h == 0x05 && low_l == 0x01){
-                        if(hardware::registers.at(high_l) > hardware::registers.at(low_h)) skip_instruction = true;
-                    
+                    case operation::op_5xy1_chip8e:
+                        if(hardware::registers.at(i.x) > hardware::registers.at(i.y)) skip_instruction = true;
+                        break;
+
                     // 5xy2 - store Vx to Vy in memory starting at I; I = I + x + 1 (CHIP-8E)
-                    }else if(high_h == 0x05 && low_l == 0x02){
-                        for(uint8_t i = high_l; i <= low_h; i++){
-                            hardware::memory.at(hardware::register_I) = hardware::registers.at(i);
+                    case operation::op_5xy2_chip8e:
+                        for(uint8_t j = i.x; j <= i.y; j++){
+                            write_memory(hardware::register_I, hardware::registers.at(j));
                             hardware::register_I++;
                         }
-                    
+                        break;
+
                     // 5xy3 - load Vx to Vy from memory starting at I; I = I + x + 1 (CHIP-8E)
-                    }else if(high_h == 0x05 && low_l == 0x03){
-                        for(uint8_t i = high_l; i <= low_h; i++){
-                            hardware::registers.at(i) = hardware::memory.at(hardware::register_I);
+                    case operation::op_5xy3_chip8e:
+                        for(uint8_t j = i.x; j <= i.y; j++){
+                            hardware::registers.at(j) = hardware::memory_at(hardware::register_I);
                             hardware::register_I++;
                         }
-                    
+                        break;
+
                     // bbnn - jump to current instruction - nn bytes (CHIP-8E)
-                    }else if(high == 0xbb){
+                    case operation::op_bbnn_chip8e:
                         hardware::pc -= 2;
-                        hardware::pc -= low;
-                    
+                        hardware::pc -= i.nn;
+                        break;
+
                     // bfnn - jump to current instruction + nn bytes (CHIP-8E)
-                    }else if(high == 0xbf){
+                    case operation::op_bfnn_chip8e:
                         hardware::pc -= 2;
-                        hardware::pc += low;
+                        hardware::pc += i.nn;
+                        break;
 
                     // fx03 - send Vx to output port 3 (CHIP-8E)
-                    }else if(high_h == 0x0f && low == 0x03){
-                        lua_getfield(L, -1, "output_port_3");
-                        if(lua_isfunction(L, -1)){
-                            lua_pushinteger(L, hardware::registers.at(high_l));
-                            lua_pcall(L, 1, 0, 0);
-                        }else{
-                            lua_pop(L, 1);
-                        }
-                    
+                    case operation::op_fx03_chip8e:
+                        queue_output(output_port_3_callback, hardware::registers.at(i.x));
+                        break;
+
                     // fx1b - skip Vx bytes (CHIP-8E)
-                    }else if(high_h == 0x0f && low == 0x1b){
-                        hardware::pc += hardware::registers.at(high_l);
-                    
+                    case operation::op_fx1b_chip8e:
+                        hardware::pc += hardware::registers.at(i.x);
+                        break;
+
                     // fx4f - delay timer = Vx; wait until the delay timer reaches 0 (CHIP-8E)
-                    }else if(high_h == 0x0f && low == 0x4f){
-                        hardware::delay_timer = hardware::registers.at(high_l);
+                    case operation::op_fx4f_chip8e:
+                        hardware::delay_timer = hardware::registers.at(i.x);
                         hardware::waiting_for_timer = true;
-                    
+                        break;
+
                     // fxe3 - wait for strobe at EF4; read Vx from input port 3 (CHIP-8E)
-                    }else if(high_h == 0x0f && low == 0xe3){
-                        lua_getfield(L, -1, "input_port_3_wait");
-                        if(lua_isfunction(L, -1)){
-                            lua_pcall(L, 0, 1, 0);
-                            hardware::registers.at(high_l) = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : 0;
-                            lua_pop(L, 1);
-                        }else{
-                            lua_pop(L, 1);
+                    case operation::op_fxe3_chip8e:
+                        if(input_port_3_wait_callback != LUA_NOREF){
+                            hardware::registers.at(i.x) = read_input(input_port_3_wait_callback);
                         }
-                    
+                        break;
+
                     // fxe7 - read Vx from input port 3 (CHIP-8E)
-                    }else if(high_h == 0x0f && low == 0xe7){
-                        lua_getfield(L, -1, "input_port_3");
-                        if(lua_isfunction(L, -1)){
-                            lua_pcall(L, 0, 1, 0);
-                            hardware::registers.at(high_l) = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : 0;
-                            lua_pop(L, 1);
-                        }else{
-                            lua_pop(L, 1);
+                    case operation::op_fxe7_chip8e:
+                        if(input_port_3_callback != LUA_NOREF){
+                            hardware::registers.at(i.x) = read_input(input_port_3_callback);
                         }
-
-                    }else{
-                        matched_opcode = false;
-                    }
-                    if(matched_opcode) return return_value;
-                }
-
-                if(instruction_set::super_chip_1_0){
-                    matched_opcode = true;
+                        break;
 
                     // 00fd - stop execution (SUPER-CHIP 1.0)
-                    if(opcode == 0x00fd){
+                    case operation::op_00fd_schip10:
                         return_value = 0;
-                    
+                        break;
+
                     // 00fe - disable high resolution mode (SUPER-CHIP 1.0)
-                    }else if(opcode == 0x00fe){
+                    case operation::op_00fe_schip10:
                         hardware::high_res = false;
                         if(quirks::quirk_00fe_00ff_clear_screen){
-                            clear_screen(f, quirks::quirk_00fe_00ff_clear_all_planes);
+                            clear_screen(quirks::quirk_00fe_00ff_clear_all_planes);
                         }
-                    
+                        break;
+
                     // 00ff - enable high resolution mode (SUPER-CHIP 1.0)
-                    }else if(opcode == 0x00ff){
+                    case operation::op_00ff_schip10:
                         if(hardware::allow_high_res) hardware::high_res = true;
                         if(quirks::quirk_00fe_00ff_clear_screen){
-                            clear_screen(f, quirks::quirk_00fe_00ff_clear_all_planes);
+                            clear_screen(quirks::quirk_00fe_00ff_clear_all_planes);
                         }
+                        break;
 
                     // fx75 - store V0 - Vx in RPL user flags (0 <= x <= 7) (SUPER-CHIP 1.0)
-                    }else if(high_h == 0x0f && low == 0x75){
+                    case operation::op_fx75_schip10:
                         if(!quirks::quirk_fx75_fx85_allow_all){
-                            if(high_l >= 8){
+                            if(i.x >= 8){
                                 throw std::runtime_error("invalid usage of opcode fx75");
                             }
                         }
 
-                        for(uint8_t i = 0; i <= high_l; i++){
-                            hardware::flag_registers.at(i) = hardware::registers.at(i);
+                        for(uint8_t j = 0; j <= i.x; j++){
+                            hardware::flag_registers.at(j) = hardware::registers.at(j);
                         }
-                    
+                        break;
+
                     // fx85 - load V0 - Vx from RPL user flags (0 <= x <= 7) (SUPER-CHIP 1.0)
-                    }else if(high_h == 0x0f && low == 0x85){
+                    case operation::op_fx85_schip10:
                         if(!quirks::quirk_fx75_fx85_allow_all){
-                            if(high_l >= 8){
+                            if(i.x >= 8){
                                 throw std::runtime_error("invalid usage of opcode fx85");
                             }
                         }
 
-                        for(uint8_t i = 0; i <= high_l; i++){
-                            hardware::registers.at(i) = hardware::flag_registers.at(i);
+                        for(uint8_t j = 0; j <= i.x; j++){
+                            hardware::registers.at(j) = hardware::flag_registers.at(j);
                         }
-
-                    }else{
-                        matched_opcode = false;
-                    }
-                    if(matched_opcode) return return_value;
-                }
-
-                if(instruction_set::super_chip_1_1){
-                    matched_opcode = true;
+                        break;
 
                     // 00cn - scroll display n pixels down (SUPER-CHIP 1.1)
-                    if(high == 0x00 && low_h == 0x0c){
-                        scroll_down(f, quirks::quirk_lowres_double_scroll && hardware::allow_high_res && !hardware::high_res ? low_l * 2 : low_l);
-                    
+                    case operation::op_00cn_schip11:
+                        scroll_down(f, quirks::quirk_lowres_double_scroll && hardware::allow_high_res && !hardware::high_res ? i.n * 2 : i.n);
+                        break;
+
                     // 00fb - scroll display 4 pixels right (SUPER-CHIP 1.1)
-                    }else if(opcode == 0x00fb){
-                        if(quirks::quirk_lowres_double_scroll && hardware::allow_high_res && !hardware::high_res) scroll_right(f);
-                        scroll_right(f);
-                    
+                    case operation::op_00fb_schip11:
+                        scroll_right(f, quirks::quirk_lowres_double_scroll && hardware::allow_high_res && !hardware::high_res ? 8 : 4);
+                        break;
+
                     // 00fc - scroll display 4 pixels left (SUPER-CHIP 1.1)
-                    }else if(opcode == 0x00fc){
-                        if(quirks::quirk_lowres_double_scroll && hardware::allow_high_res && !hardware::high_res) scroll_left(f);
-                        scroll_left(f);
-                    
-                    // fx30 - I = address of large sprite of digit in Vx (SUPER-CHIP 1.1)
-                    }else if(high_h == 0x0f && low == 0x30){
-                        hardware::register_I = 80 + (hardware::registers.at(high_l) & 0x0f) * 10;
+                    case operation::op_00fc_schip11:
+                        scroll_left(f, quirks::quirk_lowres_double_scroll && hardware::allow_high_res && !hardware::high_res ? 8 : 4);
+                        break;
 
-                    }else{
-                        matched_opcode = false;
-                    }
-                    if(matched_opcode) return return_value;
-                }
+                    // fx30 - I = address of large sprite of digit in Vx (SUPER-CHIP 1.1)
+                    case operation::op_fx30_schip11:
+                        hardware::register_I = 80 + (hardware::registers.at(i.x) & 0x0f) * 10;
+                        break;
 
-                if(instruction_set::set_rd0_fxf2){
                     // fxf2 - set the RD.0 register to x
-                    if(high_h == 0x0f && low == 0xf2){
-                        hardware::register_rd0 = high_l;
-
-                        return return_value;
-                    }
-                }
+                    case operation::op_fxf2:
+                        hardware::register_rd0 = i.x;
+                        break;
 
-                if(instruction_set::scroll_up_00bn){
                     // 00bn - scroll display n pixels up
-                    if(high_h == 0x00 && low_h == 0x0b){
-                        scroll_up(f, quirks::quirk_lowres_double_scroll && hardware::allow_high_res && !hardware::high_res ? low_l * 2 : low_l);
-                        return return_value;
-                    }
-                }
+                    case operation::op_00bn:
+                        scroll_up(f, quirks::quirk_lowres_double_scroll && hardware::allow_high_res && !hardware::high_res ? i.n * 2 : i.n);
+                        break;
 
-                if(instruction_set::chip8x){
-                    matched_opcode = true;
-                    
                     // 02a0 - step background color (CHIP-8X)
-                    if(opcode == 0x02a0){
-                        step_bg_color(f);
-                    
+                    case operation::op_02a0_chip8x:
+                        step_bg_color();
+                        break;
+
                     // 5xy1 - for each nibble in Vx, Vy: Vx = (Vx + Vy) % 8 (CHIP-8X)
-                    }else if(high_h == 0x05 && low_l == 0x01){
-                        uint8_t result1 = ((hardware::registers.at(high_l) >> 4) + (hardware::registers.at(low_h) >> 4)) % 8;
-                        uint8_t result2 = ((hardware::registers.at(high_l) & 0x0f) + (hardware::registers.at(low_h) & 0x0f)) % 8;
-                        hardware::registers.at(high_l) = (result1 << 4) | result2;
+                    case operation::op_5xy1_chip8x:{
+                        uint8_t result1 = ((hardware::registers.at(i.x) >> 4) + (hardware::registers.at(i.y) >> 4)) % 8;
+                        uint8_t result2 = ((hardware::registers.at(i.x) & 0x0f) + (hardware::registers.at(i.y) & 0x0f)) % 8;
+                        hardware::registers.at(i.x) = (result1 << 4) | result2;
+                        break;
+                    }
 
                     // bxy0 - set foreground color in area given by Vx and Vx+1 to Vy (CHIP-8X)
-                    }else if(high_h == 0x0b && low_l == 0x00){
+                    case operation::op_bxy0_chip8x:{
                         // size of the zones
                         int zone_x = hardware::screen_x / 8;
                         int zone_y = hardware::screen_y / 8;
 
                         // start coordinates
-                        unsigned int x0 = (hardware::registers.at(high_l) & 0x0f) * zone_x;
-                        unsigned int y0 = (hardware::registers.at((high_l + 1) % hardware::registers.size()) & 0x0f) * zone_y;
+                        unsigned int x0 = (hardware::registers.at(i.x) & 0x0f) * zone_x;
+                        unsigned int y0 = (hardware::registers.at((i.x + 1) % hardware::registers.size()) & 0x0f) * zone_y;
 
                         // end coordinates
-                        unsigned int x1 = x0 + zone_x + (hardware::registers.at(high_l) >> 4) * zone_x;
-                        unsigned int y1 = y0 + zone_y + (hardware::registers.at((high_l + 1) % hardware::registers.size()) >> 4) * zone_y;
+                        unsigned int x1 = x0 + zone_x + (hardware::registers.at(i.x) >> 4) * zone_x;
+                        unsigned int y1 = y0 + zone_y + (hardware::registers.at((i.x + 1) % hardware::registers.size()) >> 4) * zone_y;
 
-                        uint8_t color = hardware::registers.at(low_h);
+                        uint8_t color = hardware::registers.at(i.y);
                         if(color > 7){
                             throw std::runtime_error("invalid usage of opcode bxy0");
                         }
-                        
+
                         for(unsigned int x = x0; x < x1; x++){
                             if(x >= hardware::screen_x) break;
 
@@ -607,190 +1145,170 @@ namespace chip8{
                                 if(y >= hardware::screen_y) break;
 
                                 hardware::screen_fg_color.at(y).at(x) = color;
-                                f.draw(x, y, hardware::palette.color(this, x, y));
+                                hardware::screen_damage_rect(x, y, 1, 1);
                             }
                         }
-                        
+                        break;
+                    }
+
                     // bxyn - set foreground color at Vx,Vx+1 for n rows to Vy (CHIP-8X)
-                    }else if(high_h == 0x0b){
+                    case operation::op_bxyn_chip8x:{
                         // start coordinates
-                        unsigned int x0 = hardware::registers.at(high_l);
-                        unsigned int y0 = hardware::registers.at((high_l + 1) % hardware::registers.size());
+                        unsigned int x0 = hardware::registers.at(i.x);
+                        unsigned int y0 = hardware::registers.at((i.x + 1) % hardware::registers.size());
 
-                        uint8_t color = hardware::registers.at(low_h);
+                        uint8_t color = hardware::registers.at(i.y);
                         if(color > 7){
                             throw std::runtime_error("invalid usage of opcode bxyn");
                         }
-                        
+
                         for(unsigned int x = x0; x < x0 + 8; x++){
                             if(x >= hardware::screen_x) break;
 
-                            for(unsigned int y = y0; y < y0 + low_l; y++){
+                            for(unsigned int y = y0; y < y0 + i.n; y++){
                                 if(y >= hardware::screen_y) break;
 
                                 hardware::screen_fg_color.at(y).at(x) = color;
-                                f.draw(x, y, hardware::palette.color(this, x, y));
+                                hardware::screen_damage_rect(x, y, 1, 1);
                             }
                         }
+                        break;
+                    }
 
                     // exf2 - skip if key Vx is pressed on keyboard 2 == Vx (CHIP-8X)
-                    }else if(high_h == 0x0e && low == 0xf2){
-                        if(hardware::keyboard_2.at(hardware::registers.at(high_l))) skip_instruction = true;
-                    
+                    case operation::op_exf2_chip8x:
+                        if(hardware::key_pressed(hardware::keyboard_2, hardware::registers.at(i.x))) skip_instruction = true;
+                        break;
+
                     // exf5 - skip if key Vx is not pressed on keyboard 2 == Vx (CHIP-8X)
-                    }else if(high_h == 0x0e && low == 0xf5){
-                        if(!hardware::keyboard_2.at(hardware::registers.at(high_l))) skip_instruction = true;
+                    case operation::op_exf5_chip8x:
+                        if(!hardware::key_pressed(hardware::keyboard_2, hardware::registers.at(i.x))) skip_instruction = true;
+                        break;
 
-                    
                     // fxf8 - output Vx to port (set sound frequency) (CHIP-8X)
-                    }else if(high_h == 0x0f && low == 0xf8){
-                        f.set_audio_frequency((27535 / (hardware::registers.at(high_l) + 1)) * 8);
+                    case operation::op_fxf8_chip8x:
+                        set_audio_frequency(f, (27535 / (hardware::registers.at(i.x) + 1)) * 8);
+                        break;
 
                     // fxfb - wait for input from port and store it in Vx (CHIP-8X)
-                    }else if(high_h == 0x0f && low == 0xfb){
+                    case operation::op_fxfb_chip8x:
                         throw std::runtime_error("opcode fxfb is not implemented");
-                    
-                    }else{
-                        matched_opcode = false;
-                    }
-                    if(matched_opcode) return return_value;
-                }
 
-                if(instruction_set::xochip){
-                    matched_opcode = true;
-                    
                     // 00dn - scroll display n pixels up (XO-CHIP)
-                    if(high == 0x00 && low_h == 0x0d){
-                        scroll_up(f, quirks::quirk_lowres_double_scroll && hardware::allow_high_res && !hardware::high_res ? low_l * 2 : low_l);
+                    case operation::op_00dn_xochip:
+                        scroll_up(f, quirks::quirk_lowres_double_scroll && hardware::allow_high_res && !hardware::high_res ? i.n * 2 : i.n);
+                        break;
 
                     // 5xy2 - save Vx to Vy (ascending or descending) in memory starting at I (XO-CHIP)
-                    }else if(high_h == 0x05 && low_l == 0x02){
-                        int i = hardware::register_I;
-                        if(high_l <= low_h){
-                            for(int j = high_l; j <= low_h; j++){
-                                hardware::memory.at(i) = hardware::registers.at(j);
-                                i++;
+                    case operation::op_5xy2_xochip:{
+                        int address = hardware::register_I;
+                        if(i.x <= i.y){
+                            for(int j = i.x; j <= i.y; j++){
+                                write_memory(address, hardware::registers.at(j));
+                                address++;
                             }
                         }else{
-                            for(int j = high_l; j >= low_h; j--){
-                                hardware::memory.at(i) = hardware::registers.at(j);
-                                i++;
+                            for(int j = i.x; j >= i.y; j--){
+                                write_memory(address, hardware::registers.at(j));
+                                address++;
                             }
                         }
+                        break;
+                    }
 
                     // 5xy3 - load Vx to Vy (ascending or descending) from memory starting at I (XO-CHIP)
-                    }else if(high_h == 0x05 && low_l == 0x03){
-                        int i = hardware::register_I;
-                        if(high_l <= low_h){
-                            for(int j = high_l; j <= low_h; j++){
-                                hardware::registers.at(j) = hardware::memory.at(i);
-                                i++;
+                    case operation::op_5xy3_xochip:{
+                        int address = hardware::register_I;
+                        if(i.x <= i.y){
+                            for(int j = i.x; j <= i.y; j++){
+                                hardware::registers.at(j) = hardware::memory_at(address);
+                                address++;
                             }
                         }else{
-                            for(int j = high_l; j >= low_h; j--){
-                                hardware::registers.at(j) = hardware::memory.at(i);
-                                i++;
+                            for(int j = i.x; j >= i.y; j--){
+                                hardware::registers.at(j) = hardware::memory_at(address);
+                                address++;
                             }
                         }
+                        break;
+                    }
 
                     // f000 nnnn - I = nnnn (XO-CHIP)
-                    }else if(opcode == 0xf000){
-                        hardware::register_I = (hardware::memory.at(hardware::pc) << 8) | hardware::memory.at(hardware::pc + 1);
+                    case operation::op_f000_xochip:
+                        hardware::register_I = (hardware::memory_at(hardware::pc) << 8) | hardware::memory_at(hardware::pc + 1);
                         hardware::pc += 2;
-                    
+                        break;
+
                     // fn01 - set active drawing planes to n (XO-CHIP)
-                    }else if(high_h == 0x0f && low == 0x01){
-                        switch(high_l){
-                            case 0x00: hardware::active_screen_planes.at(0) = false; hardware::active_screen_planes.at(1) = false; break;
-                            case 0x01: hardware::active_screen_planes.at(0) = true;  hardware::active_screen_planes.at(1) = false; break;
-                            case 0x02: hardware::active_screen_planes.at(0) = false; hardware::active_screen_planes.at(1) = true;  break;
-                            case 0x03: hardware::active_screen_planes.at(0) = true;  hardware::active_screen_planes.at(1) = true;  break;
-                            default: throw std::runtime_error("invalid usage of opcode fn01");
-                        }
+                    case operation::op_fn01_xochip:
+                        if(i.x > 0x03) throw std::runtime_error("invalid usage of opcode fn01");
+                        if(hardware::screen_planes < 2) throw std::out_of_range("screen plane out of range");
+                        hardware::active_screen_planes = i.x;
+                        break;
 
                     // f002 - store 16 bytes starting at I in the audio pattern buffer (XO-CHIP)
-                    }else if(opcode == 0xf002){
-                        for(int i = 0; i < 16; i++){
-                            f.set_audio_pattern(i, hardware::memory.at(hardware::register_I + i));
+                    case operation::op_f002_xochip:
+                        for(int j = 0; j < 16; j++){
+                            hardware::audio_pattern[j] = hardware::memory_at(hardware::register_I + j);
                         }
-                    
-                    // fx3a - pitch register = Vx (XO-CHIP)
-                    }else if(high_h == 0x0f && low == 0x3a){
-                        f.set_audio_frequency(4000.0 * exp2((hardware::registers.at(high_l) - 64) / 48.0));
+                        f.set_audio_pattern(hardware::audio_pattern);
+                        break;
 
-                    }else{
-                        matched_opcode = false;
-                    }
-                    if(matched_opcode) return return_value;
-                }
+                    // fx3a - pitch register = Vx (XO-CHIP)
+                    case operation::op_fx3a_xochip:
+                        set_audio_frequency(f, 4000.0 * exp2((hardware::registers.at(i.x) - 64) / 48.0));
+                        break;
 
-                if(instruction_set::stop_0000){
                     // 0000 - stop execution
-                    if(opcode == 0x0000){
-                        return 0;
-                    }
-                }
-
-                if(instruction_set::chip8run){
-                    matched_opcode = true;
+                    case operation::op_0000:
+                        return_value = 0;
+                        break;
 
                     // 001n - stop execution with exit status n (chip8run)
-                    if(high == 0x00 && low_h == 0x01){
+                    case operation::op_001n_chip8run:
                         return_value = 0;
-                    
+                        break;
+
                     // 00fa - set override_fx55_fx65_no_increment to true (chip8run)
-                    }else if(opcode == 0x00fa){
+                    case operation::op_00fa_chip8run:
                         quirks::override_fx55_fx65_no_increment = true;
-                    
-                    }else{
-                        matched_opcode = false;
-                    }
-                    if(matched_opcode) return return_value;
-                }
-
-                if(instruction_set::eti660){
-                    matched_opcode = true;
+                        break;
 
                     // fx00 - set sound frequency (ETI-660)
-                    if(high_h == 0x0f && low == 0x00){
+                    case operation::op_fx00_eti660:
                         // i don't know the real frequency function for the ETI-660, this one is copied from CHIP-8X
-                        f.set_audio_frequency((27535 / (hardware::registers.at(high_l) + 1)) * 8);
-                    
+                        set_audio_frequency(f, (27535 / (hardware::registers.at(i.x) + 1)) * 8);
+                        break;
+
                     // 00f8 - display on (ETI-660)
-                    }else if(opcode == 0x00f8){
+                    case operation::op_00f8_eti660:
+                        hardware::draw_disabled = false;
                         f.set_draw_disabled(false);
-                        for(unsigned int x = 0; x < hardware::screen_x; x++){
-                            for(unsigned int y = 0; y < hardware::screen_y; y++){
-                                f.draw(x, y, hardware::palette.color(this, x, y));
-                            }
-                        }
+                        hardware::screen_damage_all();
+                        break;
 
                     // 00fc - display off (ETI-660)
-                    }else if(opcode == 0x00fc){
+                    case operation::op_00fc_eti660:
                         f.clear({{0, 0, 0}});
+                        hardware::draw_disabled = true;
                         f.set_draw_disabled(true);
+                        break;
 
                     // 00ff - no operation (ETI-660)
-                    }else if(opcode == 0x0ff){
-                    
-                    }else{
-                        matched_opcode = false;
-                    }
-                    if(matched_opcode) return return_value;
-                }
-
-                if(instruction_set::eti660color){
-                    matched_opcode = true;
+                    case operation::op_00ff_eti660:
+                        break;
 
                     // 07a2 - step background color (ETI-660 color)
-                    if(opcode == 0x07a2){
-                        step_bg_color(f);
-                    
+                    case operation::op_07a2_eti660color:
+                        step_bg_color();
+                        break;
+
                     // 007c1 - enable color instructions (ETI-660 color)
-                    }else if(opcode == 0x07c1){
+                    case operation::op_07c1_eti660color:
+                        break;
 
                     // 27ab - set forground color (ETI-660 color)
-                    }else if(opcode == 0x27ab){
+                    case operation::op_27ab_eti660color:{
                         size_t zone_x = hardware::registers.at(0xe);
                         size_t zone_y = hardware::registers.at(0xf);
                         uint8_t color = hardware::registers.at(0xd);
@@ -802,28 +1320,23 @@ namespace chip8{
                         for(size_t x = zone_x * 8; x < zone_x * 8 + 8; x++){
                             for(size_t y = zone_y * 2; y < zone_y * 2 + 2; y++){
                                 hardware::screen_fg_color.at(y).at(x) = color;
-                                f.draw(x, y, hardware::palette.color(this, x, y));
+                                hardware::screen_damage_rect(x, y, 1, 1);
                             }
                         }
-                    
-                    }else{
-                        matched_opcode = false;
+                        break;
                     }
-                    if(matched_opcode) return return_value;
-                }
-
-                if(instruction_set::eti660color_highres){
-                    matched_opcode = true;
 
                     // 049f - step background color (ETI-660 high res color)
-                    if(opcode == 0x049f){
-                        step_bg_color(f);
-                    
+                    case operation::op_049f_eti660color_highres:
+                        step_bg_color();
+                        break;
+
                     // 04a2 - enable color instructions (ETI-660 high res color)
-                    }else if(opcode == 0x04a2){
+                    case operation::op_04a2_eti660color_highres:
+                        break;
 
                     // 04b2 - set forground color (ETI-660 high res color)
-                    }else if(opcode == 0x04b2){
+                    case operation::op_04b2_eti660color_highres:{
                         size_t zone_x = hardware::registers.at(0x1);
                         size_t zone_y = hardware::registers.at(0x2);
                         uint8_t color = hardware::registers.at(0x0);
@@ -835,298 +1348,351 @@ namespace chip8{
                         for(size_t x = zone_x * 8; x < zone_x * 8 + 8; x++){
                             for(size_t y = zone_y * 2; y < zone_y * 2 + 2; y++){
                                 hardware::screen_fg_color.at(y).at(x) = color;
-                                f.draw(x, y, hardware::palette.color(this, x, y));
+                                hardware::screen_damage_rect(x, y, 1, 1);
                             }
                         }
-                    
-                    }else{
-                        matched_opcode = false;
+                        break;
                     }
-                    if(matched_opcode) return return_value;
-                }
-
-                if(instruction_set::chip8elf){
-                    matched_opcode = true;
 
                     // 5xy1 - skip if Vx > Vy (CHIP-8 for COSMAC ELF)
-                    if(high_h == 0x05 && low_l == 0x01){
-                        if(hardware::registers.at(high_l) > hardware::registers.at(low_h)) skip_instruction = true;
-                    
+                    case operation::op_5xy1_chip8elf:
+                        if(hardware::registers.at(i.x) > hardware::registers.at(i.y)) skip_instruction = true;
+                        break;
+
                     // 5xy2 - skip if Vx < Vy (CHIP-8 for COSMAC ELF)
-                    }else if(high_h == 0x05 && low_l == 0x02){
-                        if(hardware::registers.at(high_l) < hardware::registers.at(low_h)) skip_instruction = true;
+                    case operation::op_5xy2_chip8elf:
+                        if(hardware::registers.at(i.x) < hardware::registers.at(i.y)) skip_instruction = true;
+                        break;
 
                     // 5xy3 - skip if Vx != Vy (CHIP-8 for COSMAC ELF)
-                    }else if(high_h == 0x05 && low_l == 0x03){
-                        if(hardware::registers.at(high_l) != hardware::registers.at(low_h)) skip_instruction = true;
-                    
+                    case operation::op_5xy3_chip8elf:
+                        if(hardware::registers.at(i.x) != hardware::registers.at(i.y)) skip_instruction = true;
+                        break;
+
                     // 9xy1 - Vf,Vx = Vx * Vy (CHIP-8 for COSMAC ELF)
-                    }else if(high_h == 0x09 && low_l == 0x01){
-                        uint16_t result = (uint16_t)hardware::registers.at(high_l) * (uint16_t)hardware::registers.at(low_h);
+                    case operation::op_9xy1_chip8elf:{
+                        uint16_t result = (uint16_t)hardware::registers.at(i.x) * (uint16_t)hardware::registers.at(i.y);
                         hardware::registers.at(0xf) = result >> 8;
-                        hardware::registers.at(high_l) = result & 0xff;
-                    
+                        hardware::registers.at(i.x) = result & 0xff;
+                        break;
+                    }
+
                     // 9xy2 - Vx = Vx / Vy, Vf = remainder (CHIP-8 for COSMAC ELF)
-                    }else if(high_h == 0x09 && low_l == 0x02){
-                        uint8_t result = hardware::registers.at(high_l) / hardware::registers.at(low_h);
-                        uint8_t remainder = hardware::registers.at(high_l) % hardware::registers.at(low_h);
-                        hardware::registers.at(high_l) = result;
+                    case operation::op_9xy2_chip8elf:{
+                        uint8_t result = hardware::registers.at(i.x) / hardware::registers.at(i.y);
+                        uint8_t remainder = hardware::registers.at(i.x) % hardware::registers.at(i.y);
+                        hardware::registers.at(i.x) = result;
                         hardware::registers.at(0xf) = remainder;
-                    
+                        break;
+                    }
+
                     // 9xy3 - convert Vx,Vy to BCD stored at I,I+1,I+2,I+3,I+4 (CHIP-8 for COSMAC ELF)
-                    }else if(high_h == 0x09 && low_l == 0x03){
-                        uint16_t xy = ((uint16_t)hardware::registers.at(high_l) << 8) | (uint16_t)hardware::registers.at(low_h);
+                    case operation::op_9xy3_chip8elf:{
+                        uint16_t xy = ((uint16_t)hardware::registers.at(i.x) << 8) | (uint16_t)hardware::registers.at(i.y);
                         bcd_16_bit(xy);
-                    
+                        break;
+                    }
+
                     // fx75 - output Vx to hex display (CHIP-8 for COSMAC ELF)
-                    }else if(high_h == 0x0f && low == 0x75){
-                        lua_getfield(L, -1, "hex_display");
-                        if(lua_isfunction(L, -1)){
-                            lua_pushinteger(L, hardware::registers.at(high_l));
-                            lua_pcall(L, 1, 0, 0);
-                        }else{
-                            lua_pop(L, 1);
-                        }
+                    case operation::op_fx75_chip8elf:
+                        queue_output(hex_display_callback, hardware::registers.at(i.x));
+                        break;
 
                     // fx94 - set I to location of ASCII character in Vx (CHIP-8 for COSMAC ELF)
-                    }else if(high_h == 0x0f && low == 0x94){
-                        uint8_t character = hardware::registers.at(high_l);
+                    case operation::op_fx94_chip8elf:{
+                        uint8_t character = hardware::registers.at(i.x);
                         if(character >= 64) throw std::runtime_error("invalid usage of opcode fx94");
 
-                        uint8_t b1 = hardware::memory.at(hardware::ascii_font_start + 16 + 3 * character);
-                        uint8_t b2 = hardware::memory.at(hardware::ascii_font_start + 17 + 3 * character);
-                        uint8_t b3 = hardware::memory.at(hardware::ascii_font_start + 18 + 3 * character);
+                        uint8_t b1 = hardware::memory_at(hardware::ascii_font_start + 16 + 3 * character);
+                        uint8_t b2 = hardware::memory_at(hardware::ascii_font_start + 17 + 3 * character);
+                        uint8_t b3 = hardware::memory_at(hardware::ascii_font_start + 18 + 3 * character);
 
                         hardware::register_I = hardware::ascii_font_start + 16 + 64 * 3;
 
-                        hardware::memory.at(hardware::register_I) = hardware::memory.at(hardware::ascii_font_start + (b3 & 0x0f));
-                        hardware::memory.at(hardware::register_I + 1) = hardware::memory.at(hardware::ascii_font_start + (b2 >> 4));
-                        hardware::memory.at(hardware::register_I + 2) = hardware::memory.at(hardware::ascii_font_start + (b2 & 0x0f));
-                        hardware::memory.at(hardware::register_I + 3) = hardware::memory.at(hardware::ascii_font_start + (b1 >> 4));
-                        hardware::memory.at(hardware::register_I + 4) = hardware::memory.at(hardware::ascii_font_start + (b1 & 0x0f));
+                        write_memory(hardware::register_I, hardware::memory_at(hardware::ascii_font_start + (b3 & 0x0f)));
+                        write_memory(hardware::register_I + 1, hardware::memory_at(hardware::ascii_font_start + (b2 >> 4)));
+                        write_memory(hardware::register_I + 2, hardware::memory_at(hardware::ascii_font_start + (b2 & 0x0f)));
+                        write_memory(hardware::register_I + 3, hardware::memory_at(hardware::ascii_font_start + (b1 >> 4)));
+                        write_memory(hardware::register_I + 4, hardware::memory_at(hardware::ascii_font_start + (b1 & 0x0f)));
 
                         hardware::registers.at(0) = (b3 >> 4);
-                    
+                        break;
+                    }
+
                     // ffff nmmm - jump to nmmm (CHIP-8 for COSMAC ELF)
-                    }else if(high == 0xff && low == 0xff){
-                        hardware::pc = ((uint16_t)hardware::memory.at(hardware::pc) << 8) | (uint16_t)hardware::memory.at(hardware::pc + 1);
-                    
-                    }else{
-                        matched_opcode = false;
+                    case operation::op_ffff_chip8elf:
+                        hardware::pc = ((uint16_t)hardware::memory_at(hardware::pc) << 8) | (uint16_t)hardware::memory_at(hardware::pc + 1);
+                        break;
+
+                    // 00e0 - clear screen
+                    case operation::op_00e0:
+                        clear_screen();
+                        break;
+
+                    // 00ee - return
+                    case operation::op_00ee:
+                        hardware::pc = hardware::call_stack_pop();
+                        break;
+
+                    // 0nnn - call machine language subroutine at nnn
+                    case operation::op_0nnn:
+                        throw std::runtime_error("opcode 0nnn is not implemented");
+
+                    // 1nnn - jump to nnn
+                    case operation::op_1nnn:
+                        hardware::pc = i.nnn;
+                        break;
+
+                    // 2nnn - call subroutine at nnn
+                    case operation::op_2nnn:
+                        hardware::call_stack_push(hardware::pc);
+                        hardware::pc = i.nnn;
+                        break;
+
+                    // 3xnn - skip if Vx == nn
+                    case operation::op_3xnn:
+                        if(hardware::registers.at(i.x) == i.nn) skip_instruction = true;
+                        break;
+
+                    // 4xnn - skip if Vx != nn
+                    case operation::op_4xnn:
+                        if(hardware::registers.at(i.x) != i.nn) skip_instruction = true;
+                        break;
+
+                    // 5xy0 - skip if Vx == Vy
+                    case operation::op_5xy0:
+                        if(hardware::registers.at(i.x) == hardware::registers.at(i.y)) skip_instruction = true;
+                        break;
+
+                    // 6xnn - Vx = nn
+                    case operation::op_6xnn:
+                        hardware::registers.at(i.x) = i.nn;
+                        break;
+
+                    // 7xnn - Vx += nn
+                    case operation::op_7xnn:
+                        hardware::registers.at(i.x) += i.nn;
+                        break;
+
+                    // 8xy0 - Vx = Vy
+                    case operation::op_8xy0:
+                        hardware::registers.at(i.x) = hardware::registers.at(i.y);
+                        break;
+
+                    // 8xy1 - Vx |= Vy
+                    case operation::op_8xy1:
+                        hardware::registers.at(i.x) |= hardware::registers.at(i.y);
+                        break;
+
+                    // 8xy2 - Vx &= Vy
+                    case operation::op_8xy2:
+                        hardware::registers.at(i.x) &= hardware::registers.at(i.y);
+                        break;
+
+                    // 8xy3 - Vx ^= Vy
+                    case operation::op_8xy3:
+                        hardware::registers.at(i.x) ^= hardware::registers.at(i.y);
+                        break;
+
+                    // 8xy4 - Vx += Vy; Vf = carry ? 1 : 0
+                    case operation::op_8xy4:{
+                        uint8_t result;
+                        result = hardware::registers.at(i.x) + hardware::registers.at(i.y);
+                        uint8_t F = result <= hardware::registers.at(i.x) && hardware::registers.at(i.y) > 0 ? 0x01 : 0x00;
+                        hardware::registers.at(i.x) = result;
+                        hardware::registers.at(0xf) = F;
+                        break;
                     }
-                    if(matched_opcode) return return_value;
-                }
 
-                // 00e0 - clear screen
-                if(opcode == 0x00e0){
-                    clear_screen(f);
-                
-                // 00ee - return
-                }else if(opcode == 0x00ee){
-                    if(hardware::call_stack.size() == 0) throw std::runtime_error("call stack empty - can not return");
-                    hardware::pc = hardware::call_stack.top();
-                    hardware::call_stack.pop();
-                
-                // 0nnn - call machine language subroutine at nnn
-                }else if(high_h == 0x00){
-                    throw std::runtime_error("opcode 0nnn is not implemented");
-                
-                // 1nnn - jump to nnn
-                }else if(high_h == 0x01){
-                    hardware::pc = ((high_l << 8) | low);
-                
-                // 2nnn - call subroutine at nnn
-                }else if(high_h == 0x02){
-                    hardware::call_stack.push(hardware::pc);
-                    hardware::pc = ((high_l << 8) | low);
-                
-                // 3xnn - skip if Vx == nn
-                }else if(high_h == 0x03){
-                    if(hardware::registers.at(high_l) == low) skip_instruction = true;
-                
-                // 4xnn - skip if Vx != nn
-                }else if(high_h == 0x04){
-                    if(hardware::registers.at(high_l) != low) skip_instruction = true;
-                
-                // 5xy0 - skip if Vx == Vy
-                }else if(high_h == 0x05 && low_l == 0x00){
-                    if(hardware::registers.at(high_l) == hardware::registers.at(low_h)) skip_instruction = true;
-                
-                // 6xnn - Vx = nn
-                }else if(high_h == 0x06){
-                    hardware::registers.at(high_l) = low;
-                
-                // 7xnn - Vx += nn
-                }else if(high_h == 0x07){
-                    hardware::registers.at(high_l) += low;
-                
-                // 8xy0 - Vx = Vy
-                }else if(high_h == 0x08 && low_l == 0x00){
-                    hardware::registers.at(high_l) = hardware::registers.at(low_h);
-                
-                // 8xy1 - Vx |= Vy
-                }else if(high_h == 0x08 && low_l == 0x01){
-                    hardware::registers.at(high_l) |= hardware::registers.at(low_h);
-                
-                // 8xy2 - Vx &= Vy
-                }else if(high_h == 0x08 && low_l == 0x02){
-                    hardware::registers.at(high_l) &= hardware::registers.at(low_h);
-                    
-                // 8xy3 - Vx ^= Vy
-                }else if(high_h == 0x08 && low_l == 0x03){
-                    hardware::registers.at(high_l) ^= hardware::registers.at(low_h);
-
-                // 8xy4 - Vx += Vy; Vf = carry ? 1 : 0
-                }else if(high_h == 0x08 && low_l == 0x04){
-                    uint8_t result;
-                    result = hardware::registers.at(high_l) + hardware::registers.at(low_h);
-                    uint8_t F = result <= hardware::registers.at(high & 0xf) && hardware::registers.at(low_h) > 0 ? 0x01 : 0x00;
-                    hardware::registers.at(high_l) = result;
-                    hardware::registers.at(0xf) = F;
-
-                // 8xy5 - Vx -= Vy; Vf = borrow ? 0 : 1
-                }else if(high_h == 0x08 && low_l == 0x05){
-                    uint8_t result;
-                    result = hardware::registers.at(high_l) - hardware::registers.at(low_h);
-                    uint8_t F = result >= hardware::registers.at(high & 0xf) && hardware::registers.at(low_h) > 0 ? 0x00 : 0x01;
-                    hardware::registers.at(high_l) = result;
-                    hardware::registers.at(0xf) = F;
-
-                // 8xy6 - Vx = Vy >> 1; Vf = Vy & 0x01 
-                }else if(high_h == 0x08 && low_l == 0x06){
-                    uint8_t F;
-                    if(quirks::quirk_8xy6_8xye_shift_vx){
-                        F = hardware::registers.at(high_l) & 0x01;
-                        hardware::registers.at(high_l) = hardware::registers.at(high_l) >> 1;
-                    }else{
-                        F = hardware::registers.at(low_h) & 0x01;
-                        hardware::registers.at(high_l) = hardware::registers.at(low_h) >> 1;
+                    // 8xy5 - Vx -= Vy; Vf = borrow ? 0 : 1
+                    case operation::op_8xy5:{
+                        uint8_t result;
+                        result = hardware::registers.at(i.x) - hardware::registers.at(i.y);
+                        uint8_t F = result >= hardware::registers.at(i.x) && hardware::registers.at(i.y) > 0 ? 0x00 : 0x01;
+                        hardware::registers.at(i.x) = result;
+                        hardware::registers.at(0xf) = F;
+                        break;
                     }
-                    hardware::registers.at(0xf) = F;
-
-                // 8xy7 - Vx = Vy - Vx; Vf = borrow ? 0 : 1
-                }else if(high_h == 0x08 && low_l == 0x07){
-                    uint8_t result;
-                    result = hardware::registers.at(low_h) - hardware::registers.at(high_l);
-                    uint8_t F = result >= hardware::registers.at(low_h) && hardware::registers.at(high_l) > 0 ? 0x00 : 0x01;
-                    hardware::registers.at(high_l) = result;
-                    hardware::registers.at(0xf) = F;
-
-                // 8xye - Vx = Vy << 1; Vf = Vy & 0x80
-                }else if(high_h == 0x08 && low_l == 0x0e){
-                    uint8_t F;
-                    if(quirks::quirk_8xy6_8xye_shift_vx){
-                        F = hardware::registers.at(high_l) & 0x80;
-                        hardware::registers.at(high_l) = hardware::registers.at(high_l) << 1;
-                    }else{
-                        F = hardware::registers.at(low_h) & 0x80;
-                        hardware::registers.at(high_l) = hardware::registers.at(low_h) << 1;
+
+                    // 8xy6 - Vx = Vy >> 1; Vf = Vy & 0x01
+                    case operation::op_8xy6:{
+                        uint8_t F;
+                        if(quirks::quirk_8xy6_8xye_shift_vx){
+                            F = hardware::registers.at(i.x) & 0x01;
+                            hardware::registers.at(i.x) = hardware::registers.at(i.x) >> 1;
+                        }else{
+                            F = hardware::registers.at(i.y) & 0x01;
+                            hardware::registers.at(i.x) = hardware::registers.at(i.y) >> 1;
+                        }
+                        hardware::registers.at(0xf) = F;
+                        break;
                     }
-                    hardware::registers.at(0xf) = F ? 1 : 0;
-                
-                // 9xy0 - skip if Vx != Vy
-                }else if(high_h == 0x09 && low_l == 0x00){
-                    if(hardware::registers.at(high_l) != hardware::registers.at(low_h)) skip_instruction = true;
-
-                // annn - I = nnn
-                }else if(high_h == 0x0a){
-                    hardware::register_I = ((high_l << 8) | low);
-
-                // bnnn - jump to nnn + V0
-                }else if(high_h == 0x0b){
-                    if(quirks::quirk_bnnn_bxnn_use_vx){
-                        hardware::pc = ((high_l << 8) | low) + hardware::registers.at(high_l);
-                    }else if(quirks::quirk_bnnn_use_rd0){
-                        hardware::pc = ((high_l << 8) | low) + hardware::registers.at(hardware::register_rd0);
-                    }else{
-                        hardware::pc = ((high_l << 8) | low) + hardware::registers.at(0);
+
+                    // 8xy7 - Vx = Vy - Vx; Vf = borrow ? 0 : 1
+                    case operation::op_8xy7:{
+                        uint8_t result;
+                        result = hardware::registers.at(i.y) - hardware::registers.at(i.x);
+                        uint8_t F = result >= hardware::registers.at(i.y) && hardware::registers.at(i.x) > 0 ? 0x00 : 0x01;
+                        hardware::registers.at(i.x) = result;
+                        hardware::registers.at(0xf) = F;
+                        break;
                     }
 
-                // cxnn - Vx = random & nn
-                }else if(high_h == 0x0c){
-                    hardware::registers.at(high& 0x0f) = std::rand() & low;
-                
-                // dxyn - draw n bytes at (Vx, Vy)
-                }else if(high_h == 0x0d){
-                    draw(f, high_l, low_h, low_l);
+                    // 8xye - Vx = Vy << 1; Vf = Vy & 0x80
+                    case operation::op_8xye:{
+                        uint8_t F;
+                        if(quirks::quirk_8xy6_8xye_shift_vx){
+                            F = hardware::registers.at(i.x) & 0x80;
+                            hardware::registers.at(i.x) = hardware::registers.at(i.x) << 1;
+                        }else{
+                            F = hardware::registers.at(i.y) & 0x80;
+                            hardware::registers.at(i.x) = hardware::registers.at(i.y) << 1;
+                        }
+                        hardware::registers.at(0xf) = F ? 1 : 0;
+                        break;
+                    }
 
-                // ex9e - skip if key Vx is pressed
-                }else if(high_h == 0x0e && low == 0x9e){
-                    if(hardware::keyboard_1.at(hardware::registers.at(high_l))) skip_instruction = true;
+                    // 9xy0 - skip if Vx != Vy
+                    case operation::op_9xy0:
+                        if(hardware::registers.at(i.x) != hardware::registers.at(i.y)) skip_instruction = true;
+                        break;
+
+                    // annn - I = nnn
+                    case operation::op_annn:
+                        hardware::register_I = i.nnn;
+                        break;
+
+                    // bnnn - jump to nnn + V0
+                    case operation::op_bnnn:
+                        if(quirks::quirk_bnnn_bxnn_use_vx){
+                            hardware::pc = i.nnn + hardware::registers.at(i.x);
+                        }else if(quirks::quirk_bnnn_use_rd0){
+                            hardware::pc = i.nnn + hardware::registers.at(hardware::register_rd0);
+                        }else{
+                            hardware::pc = i.nnn + hardware::registers.at(0);
+                        }
+                        break;
+
+                    // cxnn - Vx = random & nn
+                    case operation::op_cxnn:
+                        hardware::registers.at(i.x) = hardware::random_byte() & i.nn;
+                        break;
+
+                    // dxyn - draw n bytes at (Vx, Vy)
+                    case operation::op_dxyn:
+                        draw(i.x, i.y, i.n);
+                        break;
+
+                    // ex9e - skip if key Vx is pressed
+                    case operation::op_ex9e:
+                        if(hardware::key_pressed(hardware::keyboard_1, hardware::registers.at(i.x))) skip_instruction = true;
+                        break;
+
+                    // exa1 - skip if key Vx is not pressed
+                    case operation::op_exa1:
+                        if(!hardware::key_pressed(hardware::keyboard_1, hardware::registers.at(i.x))) skip_instruction = true;
+                        break;
+
+                    // fx07 - Vx = delay timer
+                    case operation::op_fx07:
+                        hardware::registers.at(i.x) = hardware::delay_timer;
+                        break;
+
+                    // fx0a - wait for keypress; Vx = key
+                    case operation::op_fx0a:
+                        hardware::waiting_for_key = i.x;
+                        break;
+
+                    // fx15 - delay timer = Vx
+                    case operation::op_fx15:
+                        hardware::delay_timer = hardware::registers.at(i.x);
+                        break;
+
+                    // fx18 - sound timer = Vx
+                    case operation::op_fx18:
+                        hardware::sound_timer = hardware::registers.at(i.x);
+                        if(hardware::sound_timer > 1) f.set_audio_state(true);
+                        break;
+
+                    // fx1e - I += Vx
+                    case operation::op_fx1e:{
+                        uint16_t old_I = hardware::register_I;
+                        hardware::register_I += hardware::registers.at(i.x);
+                        if(quirks::quirk_fx1e_overflow_at_memory_size){
+                            hardware::register_I %= hardware::memory_size;
+                        }
+                        if(quirks::quirk_fx1e_set_vf){
+                            hardware::registers.at(0xf) = (hardware::register_I < old_I) ? 1 : 0;
+                        }
+                        break;
+                    }
 
-                // exa1 - skip if key Vx is not pressed
-                }else if(high_h == 0x0e && low == 0xa1){
-                    if(!hardware::keyboard_1.at(hardware::registers.at(high_l))) skip_instruction = true;
+                    // fx29 - I = address of sprite of hex digit in Vx
+                    case operation::op_fx29:
+                        if(quirks::quirk_fx29_digits_highres && hardware::registers.at(i.x) >= 0x10 && hardware::registers.at(i.x) <= 0x19){
+                            hardware::register_I = 80 + (hardware::registers.at(i.x) & 0x0f) * 10;
+                        }else{
+                            hardware::register_I = (hardware::registers.at(i.x) & 0x0f) * 5;
+                        }
+                        break;
 
-                // fx07 - Vx = delay timer
-                }else if(high_h == 0x0f && low == 0x07){
-                    hardware::registers.at(high_l) = hardware::delay_timer;
-                
-                // fx0a - wait for keypress; Vx = key
-                }else if(high_h == 0x0f && low == 0x0a){
-                    hardware::waiting_for_key = high_l;
+                    // fx33 - memory[I, I+1, I+2] = BCD of Vx
+                    case operation::op_fx33:
+                        bcd_of_v(i.x);
+                        break;
 
-                // fx15 - delay timer = Vx
-                }else if(high_h == 0x0f && low == 0x15){
-                    hardware::delay_timer = hardware::registers.at(high_l);
-                
-                // fx18 - sound timer = Vx
-                }else if(high_h == 0x0f && low == 0x18){
-                    hardware::sound_timer = hardware::registers.at(high_l);
-                    if(hardware::sound_timer > 1) f.set_audio_state(true);
-                
-                // fx1e - I += Vx
-                }else if(high_h == 0x0f && low == 0x1e){
-                    uint16_t old_I = hardware::register_I;
-                    hardware::register_I += hardware::registers.at(high_l);
-                    if(quirks::quirk_fx1e_overflow_at_memory_size){
-                        hardware::register_I %= hardware::memory.size();
-                    }
-                    if(quirks::quirk_fx1e_set_vf){
-                        hardware::registers.at(0xf) = (hardware::register_I < old_I) ? 1 : 0;
-                    }
-                
-                // fx29 - I = address of sprite of hex digit in Vx
-                }else if(high_h == 0x0f && low == 0x29){
-                    if(quirks::quirk_fx29_digits_highres && hardware::registers.at(high_l) >= 0x10 && hardware::registers.at(high_l) <= 0x19){
-                        hardware::register_I = 80 + (hardware::registers.at(high_l) & 0x0f) * 10;
-                    }else{
-                        hardware::register_I = (hardware::registers.at(high_l) & 0x0f) * 5;
-                    }
-                
-                // fx33 - memory[I, I+1, I+2] = BCD of Vx
-                }else if(high_h == 0x0f && low == 0x33){
-                    bcd_of_v(high_l);
-
-                // fx55 - store V0 to Vx in memory starting at I; I = I + x + 1
-                }else if(high_h == 0x0f && low == 0x55){
-                    for(uint8_t i = (quirks::quirk_fx55_fx65_use_rd0 ? hardware::register_rd0 : 0); i <= (high_l); i++){
-                        hardware::memory.at(hardware::register_I) = hardware::registers.at(i);
-                        hardware::register_I++;
-                    }
-                    
-                    if(quirks::quirk_fx55_fx65_increment_less)
-                        hardware::register_I--;
-                    else if(quirks::quirk_fx55_fx65_no_increment || quirks::override_fx55_fx65_no_increment)
-                        hardware::register_I -= (high_l + 1);
-
-                // fx65 - load V0 to Vx from memory starting at I; I = I + x + 1
-                }else if(high_h == 0x0f && low == 0x65){
-                    for(uint8_t i = (quirks::quirk_fx55_fx65_use_rd0 ? hardware::register_rd0 : 0); i <= high_l; i++){
-                        hardware::registers.at(i) = hardware::memory.at(hardware::register_I);
-                        hardware::register_I++;
-                    }
+                    // fx55 - store V0 to Vx in memory starting at I; I = I + x + 1
+                    case operation::op_fx55:
+                        for(uint8_t j = (quirks::quirk_fx55_fx65_use_rd0 ? hardware::register_rd0 : 0); j <= i.x; j++){
+                            write_memory(hardware::register_I, hardware::registers.at(j));
+                            hardware::register_I++;
+                        }
 
-                    if(quirks::quirk_fx55_fx65_increment_less)
-                        hardware::register_I--;
-                    else if(quirks::quirk_fx55_fx65_no_increment || quirks::override_fx55_fx65_no_increment)
-                        hardware::register_I -= (high_l + 1);
+                        if(quirks::quirk_fx55_fx65_increment_less)
+                            hardware::register_I--;
+                        else if(quirks::quirk_fx55_fx65_no_increment || quirks::override_fx55_fx65_no_increment)
+                            hardware::register_I -= (i.x + 1);
+                        break;
 
-                }else{
-                    throw std::runtime_error("unkown opcode");
+                    // fx65 - load V0 to Vx from memory starting at I; I = I + x + 1
+                    case operation::op_fx65:
+                        for(uint8_t j = (quirks::quirk_fx55_fx65_use_rd0 ? hardware::register_rd0 : 0); j <= i.x; j++){
+                            hardware::registers.at(j) = hardware::memory_at(hardware::register_I);
+                            hardware::register_I++;
+                        }
+
+                        if(quirks::quirk_fx55_fx65_increment_less)
+                            hardware::register_I--;
+                        else if(quirks::quirk_fx55_fx65_no_increment || quirks::override_fx55_fx65_no_increment)
+                            hardware::register_I -= (i.x + 1);
+                        break;
+
+                    default:
+                        throw std::runtime_error("unkown opcode");
                 }
 
                 return return_value;
             }
     };
+
+    /// an interpreter for an instruction set and quirks that are known at compile time
+    template<class instruction_set, class quirks> struct specialization{
+        using interpreter = chip8_interpreter<instruction_set, quirks, chip8_hardware<chip8_palette>>;
+
+        static bool matches(uint32_t instruction_set_flags, uint32_t quirk_flags){
+            return instruction_set_flags == instruction_set::fixed_flags && quirk_flags == quirks::fixed_flags;
+        }
+    };
+
+    /// the specializations for the common modes, the first that matches a mode runs it, the generic interpreter runs all others
+    using specializations = std::tuple<
+        specialization<iset_chip8, quirks_chip8>,
+        specialization<iset_chip8, quirks_chip48>,
+        specialization<iset_schip10, quirks_schip10>,
+        specialization<iset_schip11, quirks_schip11>,
+        specialization<iset_schip11, quirks_schpc>,
+        specialization<iset_chip8x, quirks_chip8>,
+        specialization<iset_xochip, quirks_xochip>,
+        specialization<iset_octo, quirks_octo>
+    >;
 }
@@ -0,0 +1,249 @@
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <stdexcept>
+#include <initializer_list>
+
+#if defined(__x86_64__) && defined(__unix__)
+#define CHIP8_JIT_X86_64
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace chip8{
+    /** Translates straight-line register instructions into native x86-64 code.
+    The generated function gets a pointer to V0-Vf and a pointer to I,
+    everything else (memory, screen, timers, keys, control flow) is left to the interpreter.
+    On other platforms nothing is compiled and the interpreter is used.
+    The code lives in chunks of executable memory, a chunk is freed once all of its functions have been released,
+    and no more than max_chunks are allocated.
+    */
+    class chip8_jit{
+        public:
+            /// a compiled sequence of instructions
+            using native_function = void (*)(uint8_t *registers, uint16_t *register_I);
+
+            /// true if native code can be generated on this platform
+#ifdef CHIP8_JIT_X86_64
+            static constexpr bool available = true;
+#else
+            static constexpr bool available = false;
+#endif
+
+            chip8_jit() = default;
+            chip8_jit(const chip8_jit &) = delete;
+            chip8_jit &operator=(const chip8_jit &) = delete;
+
+            ~chip8_jit(){
+#ifdef CHIP8_JIT_X86_64
+                for(chunk &c : chunks){
+                    munmap(c.data, c.size);
+                }
+#endif
+            }
+
+            /// returns true if the instruction can be compiled
+            static bool can_compile(operation op){
+                switch(op){
+                    case operation::op_6xnn: case operation::op_7xnn:
+                    case operation::op_8xy0: case operation::op_8xy1: case operation::op_8xy2: case operation::op_8xy3:
+                    case operation::op_8xy4: case operation::op_8xy5: case operation::op_8xy6: case operation::op_8xy7:
+                    case operation::op_8xye: case operation::op_annn:
+                        return available;
+                    default:
+                        return false;
+                }
+            }
+
+            /**
+             * @brief compile a sequence of instructions
+             *
+             * All instructions must satisfy can_compile().
+             * @param quirk_8xy6_8xye_shift_vx the quirk of the interpreter
+             * @return the native function or nullptr if it couldn't be compiled or the code memory is full
+             */
+            native_function compile(const std::vector<instruction> &instructions, bool quirk_8xy6_8xye_shift_vx){
+                code.clear();
+
+                for(const instruction &i : instructions){
+                    switch(i.op){
+                        // 6xnn - mov byte [rdi+x], nn
+                        case operation::op_6xnn:
+                            emit({0xc6, 0x47, i.x, i.nn});
+                            break;
+
+                        // 7xnn - add byte [rdi+x], nn
+                        case operation::op_7xnn:
+                            emit({0x80, 0x47, i.x, i.nn});
+                            break;
+
+                        // 8xy0 - mov al, [rdi+y]; mov [rdi+x], al
+                        case operation::op_8xy0:
+                            load_al(i.y);
+                            store_al(i.x);
+                            break;
+
+                        // 8xy1, 8xy2, 8xy3 - or/and/xor al, cl
+                        case operation::op_8xy1:
+                            binary_operation(i, 0x08);
+                            break;
+                        case operation::op_8xy2:
+                            binary_operation(i, 0x20);
+                            break;
+                        case operation::op_8xy3:
+                            binary_operation(i, 0x30);
+                            break;
+
+                        // 8xy4 - add al, cl; Vf = carry
+                        case operation::op_8xy4:
+                            binary_operation(i, 0x00, 0x92);
+                            break;
+
+                        // 8xy5 - sub al, cl; Vf = not borrow
+                        case operation::op_8xy5:
+                            binary_operation(i, 0x28, 0x93);
+                            break;
+
+                        // 8xy7 - Vx = Vy - Vx; Vf = not borrow
+                        case operation::op_8xy7:
+                            load_al(i.y);
+                            emit({0x2a, 0x47, i.x}); // sub al, [rdi+x]
+                            emit({0x0f, 0x93, 0xc2}); // setnc dl
+                            store_al(i.x);
+                            store_dl_vf();
+                            break;
+
+                        // 8xy6, 8xye - shr/shl al, 1; Vf = shifted out bit
+                        case operation::op_8xy6:
+                        case operation::op_8xye:
+                            load_al(quirk_8xy6_8xye_shift_vx ? i.x : i.y);
+                            emit({0xd0, static_cast<uint8_t>(i.op == operation::op_8xy6 ? 0xe8 : 0xe0)});
+                            emit({0x0f, 0x92, 0xc2}); // setc dl
+                            store_al(i.x);
+                            store_dl_vf();
+                            break;
+
+                        // annn - mov word [rsi], nnn
+                        case operation::op_annn:
+                            emit({0x66, 0xc7, 0x06, static_cast<uint8_t>(i.nnn & 0xff), static_cast<uint8_t>(i.nnn >> 8)});
+                            break;
+
+                        default:
+                            return nullptr;
+                    }
+                }
+
+                // ret
+                emit({0xc3});
+
+                return install();
+            }
+
+            /// free the memory of a function returned by compile(), it must not be called afterwards
+            void release(native_function function){
+#ifdef CHIP8_JIT_X86_64
+                const uint8_t *address = reinterpret_cast<const uint8_t *>(function);
+                for(size_t i = 0; i < chunks.size(); i++){
+                    chunk &c = chunks[i];
+                    if(address < c.data || address >= c.data + c.size) continue;
+
+                    if(--c.functions == 0){
+                        if(i + 1 == chunks.size()){
+                            // the chunk new code goes into is reused from its start
+                            c.used = 0;
+                        }else{
+                            munmap(c.data, c.size);
+                            chunks.erase(chunks.begin() + i);
+                        }
+                    }
+                    return;
+                }
+#else
+                (void)function;
+#endif
+            }
+
+            /// bytes of executable memory allocated
+            size_t get_code_size() const{
+                return chunks.size() * chunk_size;
+            }
+
+        private:
+            /// a block of executable memory
+            struct chunk{
+                uint8_t *data;
+                size_t size;
+                size_t used;
+                /// number of installed functions that haven't been released
+                size_t functions;
+            };
+
+            static constexpr size_t chunk_size = 64 * 1024;
+            /// at most 4 MiB of native code, a program that keeps rewriting itself can't take more
+            static constexpr size_t max_chunks = 64;
+
+            std::vector<chunk> chunks;
+            std::vector<uint8_t> code;
+
+            void emit(std::initializer_list<uint8_t> bytes){
+                code.insert(code.end(), bytes);
+            }
+
+            /// mov al, [rdi+r]
+            void load_al(uint8_t r){
+                emit({0x8a, 0x47, r});
+            }
+
+            /// mov [rdi+r], al
+            void store_al(uint8_t r){
+                emit({0x88, 0x47, r});
+            }
+
+            /// mov [rdi+15], dl
+            void store_dl_vf(){
+                emit({0x88, 0x57, 0x0f});
+            }
+
+            /// Vx = Vx op Vy, optionally Vf = setcc
+            void binary_operation(const instruction &i, uint8_t op, uint8_t setcc = 0){
+                load_al(i.x);
+                emit({0x8a, 0x4f, i.y}); // mov cl, [rdi+y]
+                emit({op, 0xc8});
+                if(setcc) emit({0x0f, setcc, 0xc2});
+                store_al(i.x);
+                if(setcc) store_dl_vf();
+            }
+
+            /// copy the generated code into executable memory
+            native_function install(){
+#ifdef CHIP8_JIT_X86_64
+                if(chunks.empty() || chunks.back().used + code.size() > chunks.back().size){
+                    if(chunks.size() == max_chunks) return nullptr;
+
+                    void *data = mmap(nullptr, chunk_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                    if(data == MAP_FAILED){
+                        throw std::runtime_error("couldn't allocate memory for native code");
+                    }
+                    chunks.push_back({static_cast<uint8_t *>(data), chunk_size, 0, 0});
+                }
+
+                // the chunk is never writable and executable at the same time
+                chunk &c = chunks.back();
+                if(mprotect(c.data, c.size, PROT_READ | PROT_WRITE)){
+                    throw std::runtime_error("couldn't make native code writable");
+                }
+                uint8_t *function = c.data + c.used;
+                std::memcpy(function, code.data(), code.size());
+                c.used += (code.size() + 15) & ~size_t(15);
+                c.functions++;
+                if(mprotect(c.data, c.size, PROT_READ | PROT_EXEC)){
+                    throw std::runtime_error("couldn't make native code executable");
+                }
+
+                return reinterpret_cast<native_function>(function);
+#else
+                return nullptr;
+#endif
+            }
+    };
+}
@@ -0,0 +1,507 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+extern "C"
+{
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+}
+
+namespace chip8{
+    /// FNV-1a hash of size bytes, h continues an earlier hash
+    inline uint64_t fnv1a(const void *data, size_t size, uint64_t h = 0xcbf29ce484222325){
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+        for(size_t i = 0; i < size; i++){
+            h = (h ^ bytes[i]) * 0x100000001b3;
+        }
+        return h;
+    }
+
+    /** The settings of a mode.
+    The Lua table of a mode is read once into this, the interpreter and its parts are configured from it.
+    Only the callbacks of a mode need the Lua state afterwards, so a mode without callbacks can be cached (see mode_cache).
+    */
+    struct mode_config{
+        /// combination of instruction_set_flags
+        uint32_t instruction_set_flags = 0;
+        /// use the dispatch table instead of decoding every opcode
+        bool table_decoder = false;
+        /// combination of quirk_flags
+        uint32_t quirk_flags = 0;
+
+        // hardware
+        unsigned int screen_x = 64;
+        unsigned int screen_y = 32;
+        unsigned int screen_planes = 1;
+        uint16_t program_start = 0x0200;
+        /// instructions per 60 Hz frame
+        unsigned int cycles_per_frame = 16;
+        size_t memory_size = 4096;
+        bool allow_high_res = false;
+        uint16_t ascii_font_start = 0;
+
+        /// use the font of the mode instead of the default fonts
+        bool custom_font = false;
+        /// bytes of the font and their address
+        std::vector<std::pair<size_t, std::vector<uint8_t>>> font;
+
+        /// palette type, empty for CHIP-8
+        std::string palette_type;
+        /// colors of the mode, components below 0 keep the default color
+        std::array<std::array<int, 3>, 8> palette_colors;
+
+        /// timer source, empty for the clock
+        std::string timers;
+        bool block_engine = false;
+        bool jit = false;
+        bool jit_check = false;
+
+        /// seed of the random number generator for cxnn, 0 picks one at startup
+        uint64_t seed = 0;
+
+        /// the mode defines callbacks, which need its Lua state
+        bool callbacks = false;
+
+        mode_config(){
+            for(std::array<int, 3> &color : palette_colors) color.fill(-1);
+        }
+
+        /// read the mode table at the top of the stack
+        explicit mode_config(lua_State *L) : mode_config(){
+            static constexpr std::pair<const char *, uint32_t> extensions[] = {
+                {"chip8e", instruction_set_flags::chip8e},
+                {"super_chip_1_0", instruction_set_flags::super_chip_1_0},
+                {"super_chip_1_1", instruction_set_flags::super_chip_1_1},
+                {"scroll_up_00bn", instruction_set_flags::scroll_up_00bn},
+                {"set_rd0_fxf2", instruction_set_flags::set_rd0_fxf2},
+                {"chip8x", instruction_set_flags::chip8x},
+                {"xochip", instruction_set_flags::xochip},
+                {"stop_0000", instruction_set_flags::stop_0000},
+                {"chip8run", instruction_set_flags::chip8run},
+                {"eti660", instruction_set_flags::eti660},
+                {"eti660color", instruction_set_flags::eti660color},
+                {"eti660color_highres", instruction_set_flags::eti660color_highres},
+                {"chip8elf", instruction_set_flags::chip8elf},
+            };
+            static constexpr std::pair<const char *, uint32_t> quirks[] = {
+                {"bnnn_bxnn_use_vx", quirk_flags::quirk_bnnn_bxnn_use_vx},
+                {"fx55_fx65_increment_less", quirk_flags::quirk_fx55_fx65_increment_less},
+                {"fx55_fx65_no_increment", quirk_flags::quirk_fx55_fx65_no_increment},
+                {"8xy6_8xye_shift_vx", quirk_flags::quirk_8xy6_8xye_shift_vx},
+                {"dxy0_16x16_highres", quirk_flags::quirk_dxy0_16x16_highres},
+                {"dxy0_16x16_lowres", quirk_flags::quirk_dxy0_16x16_lowres},
+                {"dxy0_8x16_lowres", quirk_flags::quirk_dxy0_8x16_lowres},
+                {"fx29_digits_highres", quirk_flags::quirk_fx29_digits_highres},
+                {"dxyn_count_collisions_highres", quirk_flags::quirk_dxyn_count_collisions_highres},
+                {"dxyn_no_wrapping", quirk_flags::quirk_dxyn_no_wrapping},
+                {"fx55_fx65_use_rd0", quirk_flags::quirk_fx55_fx65_use_rd0},
+                {"bnnn_use_rd0", quirk_flags::quirk_bnnn_use_rd0},
+                {"fx75_fx85_allow_all", quirk_flags::quirk_fx75_fx85_allow_all},
+                {"00fe_00ff_clear_screen", quirk_flags::quirk_00fe_00ff_clear_screen},
+                {"fx1e_set_vf", quirk_flags::quirk_fx1e_set_vf},
+                {"fx1e_overflow_at_memory_size", quirk_flags::quirk_fx1e_overflow_at_memory_size},
+                {"00fe_00ff_clear_all_planes", quirk_flags::quirk_00fe_00ff_clear_all_planes},
+                {"lowres_double_scroll", quirk_flags::quirk_lowres_double_scroll},
+            };
+
+            instruction_set_flags = read_flags(L, "instruction_set", extensions);
+            table_decoder = read_string(L, "decoder") == "table";
+            quirk_flags = read_flags(L, "quirks", quirks);
+
+            screen_x = read_integer(L, "x", 64);
+            screen_y = read_integer(L, "y", 32);
+            screen_planes = read_integer(L, "planes", 1);
+            program_start = read_integer(L, "program_start", 0x0200);
+            // defaults to one instruction per frametime microseconds
+            lua_Integer frametime = read_integer(L, "frametime", 1000);
+            if(frametime <= 0){
+                throw std::runtime_error("frametime must be positive");
+            }
+            lua_Integer cycles = read_integer(L, "cycles_per_frame", std::max<lua_Integer>(1, (1000000 / 60) / frametime));
+            if(cycles <= 0){
+                throw std::runtime_error("cycles_per_frame must be positive");
+            }
+            cycles_per_frame = cycles;
+            memory_size = read_integer(L, "memory_size", 4096);
+            allow_high_res = read_boolean(L, "allow_high_res");
+            ascii_font_start = read_integer(L, "ascii_font_start", 0);
+
+            lua_getfield(L, -1, "font");
+            if(lua_istable(L, -1)){
+                custom_font = true;
+                lua_pushnil(L);
+                while(lua_next(L, -2)){
+                    if(lua_isinteger(L, -2) && lua_istable(L, -1)){
+                        std::vector<uint8_t> bytes(lua_rawlen(L, -1));
+                        for(size_t i = 0; i < bytes.size(); i++){
+                            lua_geti(L, -1, i + 1);
+                            bytes[i] = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : 0x00;
+                            lua_pop(L, 1);
+                        }
+                        font.emplace_back(lua_tointeger(L, -2), std::move(bytes));
+                    }
+                    lua_pop(L, 1);
+                }
+            }
+            lua_pop(L, 1);
+
+            lua_getfield(L, -1, "palette");
+            if(lua_istable(L, -1)){
+                palette_type = read_string(L, "type");
+                for(size_t i = 0; i < palette_colors.size(); i++){
+                    lua_geti(L, -1, i + 1);
+                    if(lua_istable(L, -1)){
+                        for(int j = 0; j < 3; j++){
+                            lua_geti(L, -1, j + 1);
+                            if(lua_isinteger(L, -1)) palette_colors[i][j] = static_cast<uint8_t>(lua_tointeger(L, -1));
+                            lua_pop(L, 1);
+                        }
+                    }
+                    lua_pop(L, 1);
+                }
+            }
+            lua_pop(L, 1);
+
+            timers = read_string(L, "timers");
+            block_engine = read_string(L, "engine") == "block";
+            lua_getfield(L, -1, "jit");
+            jit_check = lua_type(L, -1) == LUA_TSTRING && std::string(lua_tostring(L, -1)) == "check";
+            jit = jit_check || (lua_isboolean(L, -1) && lua_toboolean(L, -1));
+            lua_pop(L, 1);
+            seed = static_cast<uint64_t>(read_integer(L, "seed", 0));
+
+            for(const char *name : {"output_port_3", "input_port_3_wait", "input_port_3", "hex_display"}){
+                lua_getfield(L, -1, name);
+                callbacks |= lua_isfunction(L, -1);
+                lua_pop(L, 1);
+            }
+        }
+
+        /// write the settings in the format of the mode cache (native byte order)
+        void write(std::ostream &out) const{
+            write_value(out, instruction_set_flags);
+            write_value(out, table_decoder);
+            write_value(out, quirk_flags);
+            write_value(out, screen_x);
+            write_value(out, screen_y);
+            write_value(out, screen_planes);
+            write_value(out, program_start);
+            write_value(out, cycles_per_frame);
+            write_value(out, memory_size);
+            write_value(out, allow_high_res);
+            write_value(out, ascii_font_start);
+            write_value(out, custom_font);
+            write_value(out, font.size());
+            for(const auto &[offset, bytes] : font){
+                write_value(out, offset);
+                write_value(out, bytes.size());
+                out.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+            }
+            write_string(out, palette_type);
+            write_value(out, palette_colors);
+            write_string(out, timers);
+            write_value(out, block_engine);
+            write_value(out, jit);
+            write_value(out, jit_check);
+            write_value(out, seed);
+            write_value(out, callbacks);
+        }
+
+        /// identifies the settings, e.g. to match save states to their mode
+        uint64_t hash() const{
+            std::ostringstream out;
+            write(out);
+            std::string data = out.str();
+            return fnv1a(data.data(), data.size());
+        }
+
+        /// read settings written by write(), returns false if the data is incomplete
+        bool read(std::istream &in){
+            read_value(in, instruction_set_flags);
+            read_value(in, table_decoder);
+            read_value(in, quirk_flags);
+            read_value(in, screen_x);
+            read_value(in, screen_y);
+            read_value(in, screen_planes);
+            read_value(in, program_start);
+            read_value(in, cycles_per_frame);
+            read_value(in, memory_size);
+            read_value(in, allow_high_res);
+            read_value(in, ascii_font_start);
+            read_value(in, custom_font);
+            size_t font_parts = 0;
+            read_value(in, font_parts);
+            font.clear();
+            for(size_t i = 0; i < font_parts && in; i++){
+                size_t offset = 0, length = 0;
+                read_value(in, offset);
+                read_value(in, length);
+                // a damaged length must not allocate much more than the file holds
+                if(!in || length > memory_size) return false;
+                std::vector<uint8_t> bytes(length);
+                in.read(reinterpret_cast<char *>(bytes.data()), length);
+                font.emplace_back(offset, std::move(bytes));
+            }
+            read_string(in, palette_type);
+            read_value(in, palette_colors);
+            read_string(in, timers);
+            read_value(in, block_engine);
+            read_value(in, jit);
+            read_value(in, jit_check);
+            read_value(in, seed);
+            read_value(in, callbacks);
+
+            // the whole file must be used
+            return in && in.peek() == std::char_traits<char>::eof();
+        }
+
+        template<class T> static void write_value(std::ostream &out, const T &value){
+            out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+        }
+
+        template<class T> static void read_value(std::istream &in, T &value){
+            in.read(reinterpret_cast<char *>(&value), sizeof(T));
+        }
+
+        static void write_string(std::ostream &out, const std::string &s){
+            write_value(out, s.size());
+            out.write(s.data(), s.size());
+        }
+
+        static void read_string(std::istream &in, std::string &s){
+            size_t length = 0;
+            read_value(in, length);
+            if(!in || length > 4096){
+                in.setstate(std::ios::failbit);
+                return;
+            }
+            s.resize(length);
+            in.read(s.data(), length);
+        }
+
+        private:
+            static lua_Integer read_integer(lua_State *L, const char *name, lua_Integer default_value){
+                lua_getfield(L, -1, name);
+                lua_Integer value = lua_isinteger(L, -1) ? lua_tointeger(L, -1) : default_value;
+                lua_pop(L, 1);
+                return value;
+            }
+
+            static bool read_boolean(lua_State *L, const char *name){
+                lua_getfield(L, -1, name);
+                bool value = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
+                lua_pop(L, 1);
+                return value;
+            }
+
+            static std::string read_string(lua_State *L, const char *name){
+                lua_getfield(L, -1, name);
+                std::string value = lua_isstring(L, -1) ? lua_tostring(L, -1) : "";
+                lua_pop(L, 1);
+                return value;
+            }
+
+            /// returns the flags of the names that are true in the subtable name
+            template<size_t n> static uint32_t read_flags(lua_State *L, const char *name, const std::pair<const char *, uint32_t> (&names)[n]){
+                uint32_t flags = 0;
+                lua_getfield(L, -1, name);
+                if(lua_istable(L, -1)){
+                    for(const auto &[key, flag] : names){
+                        if(read_boolean(L, key)) flags |= flag;
+                    }
+                }
+                lua_pop(L, 1);
+                return flags;
+            }
+    };
+
+    /** Runs a mode definition.
+    The directory of the mode is added to the package path, so that it can require e.g. fonts.fish.
+    The returned state has the mode table at the top of the stack.
+    */
+    inline lua_State *load_mode(const std::filesystem::path &mode){
+        lua_State *L = luaL_newstate();
+        luaL_openlibs(L);
+        luaL_dostring(L, ("package.path = package.path .. ';" + mode.parent_path().string() + "/?.lua'").c_str());
+
+        if(luaL_dofile(L, mode.string().c_str()) != LUA_OK){
+            std::string error = lua_tostring(L, -1);
+            lua_close(L);
+            throw std::runtime_error(error);
+        }
+        if(!lua_istable(L, -1)){
+            lua_close(L);
+            throw std::runtime_error(mode.string() + " did not return a table");
+        }
+
+        return L;
+    }
+
+    /// returns the files of the modules that a mode loaded with require, the stack is left unchanged
+    inline std::vector<std::filesystem::path> mode_dependencies(lua_State *L){
+        static constexpr const char *find_modules =
+            "local files = {} "
+            "for name in pairs(package.loaded) do "
+            "local file = package.searchpath(name, package.path) "
+            "if file then files[#files + 1] = file end "
+            "end "
+            "return files";
+
+        std::vector<std::filesystem::path> files;
+        if(luaL_dostring(L, find_modules) != LUA_OK){
+            lua_pop(L, 1);
+            return files;
+        }
+        for(lua_Integer i = 1; i <= static_cast<lua_Integer>(lua_rawlen(L, -1)); i++){
+            lua_geti(L, -1, i);
+            if(lua_isstring(L, -1)) files.emplace_back(lua_tostring(L, -1));
+            lua_pop(L, 1);
+        }
+        lua_pop(L, 1);
+
+        std::sort(files.begin(), files.end());
+        return files;
+    }
+
+    /** A cache of mode_config in binary files, so that a mode can be started without running Lua.
+    An entry belongs to the path and content of a mode file. It records the files that the mode required,
+    e.g. its font, with their hashes and is only used while all of them are unchanged.
+    Modes with callbacks are not cached, they need their Lua state anyway.
+    Every error makes the cache miss, the mode is then read from Lua as usual.
+    */
+    class mode_cache{
+        public:
+            explicit mode_cache(std::filesystem::path directory) : directory(std::move(directory)){}
+
+            /// $XDG_CACHE_HOME/chip8 or ~/.cache/chip8, empty if neither is set
+            static std::filesystem::path default_directory(){
+                if(const char *cache = std::getenv("XDG_CACHE_HOME"); cache && *cache){
+                    return std::filesystem::path(cache) / "chip8";
+                }
+                if(const char *home = std::getenv("HOME"); home && *home){
+                    return std::filesystem::path(home) / ".cache" / "chip8";
+                }
+                return {};
+            }
+
+            /// returns true and sets config if there is a valid entry for the mode
+            bool load(const std::filesystem::path &mode, mode_config &config){
+                std::string content;
+                if(directory.empty() || !read_file(mode, content)) return false;
+
+                std::ifstream in(entry_path(mode, content), std::ios::binary);
+                if(!in) return false;
+
+                char file_magic[sizeof(magic)] = {};
+                uint32_t file_version = 0;
+                in.read(file_magic, sizeof(file_magic));
+                mode_config::read_value(in, file_version);
+                if(!in || !std::equal(std::begin(magic), std::end(magic), file_magic) || file_version != version) return false;
+
+                // the mode itself is the first dependency
+                size_t dependencies = 0;
+                mode_config::read_value(in, dependencies);
+                for(size_t i = 0; i < dependencies && in; i++){
+                    std::string file;
+                    uint64_t file_hash = 0;
+                    mode_config::read_string(in, file);
+                    mode_config::read_value(in, file_hash);
+
+                    std::string dependency;
+                    if(!in || !read_file(file, dependency) || hash(dependency) != file_hash) return false;
+                }
+                if(!in || dependencies == 0) return false;
+
+                mode_config cached;
+                if(!cached.read(in) || cached.callbacks) return false;
+                config = std::move(cached);
+                return true;
+            }
+
+            /// write an entry for the mode and the files it required
+            void store(const std::filesystem::path &mode, const std::vector<std::filesystem::path> &dependencies, const mode_config &config){
+                std::string content;
+                if(directory.empty() || config.callbacks || !read_file(mode, content)) return;
+
+                std::error_code error;
+                std::filesystem::create_directories(directory, error);
+                if(error) return;
+
+                std::filesystem::path entry = entry_path(mode, content);
+                // write into a file of its own and rename it, other processes may read the entry at the same time
+                std::filesystem::path temporary = entry;
+                temporary += "." + std::to_string(std::random_device()()) + ".tmp";
+                {
+                    std::ofstream out(temporary, std::ios::binary);
+                    out.write(magic, sizeof(magic));
+                    mode_config::write_value(out, version);
+
+                    mode_config::write_value(out, dependencies.size() + 1);
+                    mode_config::write_string(out, std::filesystem::absolute(mode, error).string());
+                    mode_config::write_value(out, hash(content));
+                    for(const std::filesystem::path &file : dependencies){
+                        std::string dependency;
+                        if(!read_file(file, dependency)){
+                            out.setstate(std::ios::failbit);
+                            break;
+                        }
+                        mode_config::write_string(out, std::filesystem::absolute(file, error).string());
+                        mode_config::write_value(out, hash(dependency));
+                    }
+
+                    config.write(out);
+                    if(!out){
+                        out.close();
+                        std::filesystem::remove(temporary, error);
+                        return;
+                    }
+                }
+                std::filesystem::rename(temporary, entry, error);
+                if(error) std::filesystem::remove(temporary, error);
+            }
+
+        private:
+            static constexpr char magic[8] = {'C', 'H', 'I', 'P', '8', 'M', 'O', 'D'};
+            /// increase on every change of mode_config::write()
+            static constexpr uint32_t version = 2;
+
+            std::filesystem::path directory;
+
+            static uint64_t hash(const std::string &data, uint64_t h = 0xcbf29ce484222325){
+                return fnv1a(data.data(), data.size(), h);
+            }
+
+            static bool read_file(const std::filesystem::path &file, std::string &content){
+                std::ifstream in(file, std::ios::binary);
+                if(!in) return false;
+                content.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+                return !in.bad();
+            }
+
+            /// the entry is named after the hash of the absolute path and the content of the mode
+            std::filesystem::path entry_path(const std::filesystem::path &mode, const std::string &content){
+                std::error_code error;
+                uint64_t h = hash(content, hash(std::filesystem::absolute(mode, error).string()));
+
+                static constexpr char digits[] = "0123456789abcdef";
+                std::string name(16, '0');
+                for(int i = 15; i >= 0; i--, h >>= 4){
+                    name[i] = digits[h & 0xf];
+                }
+                return directory / (name + ".mode");
+            }
+    };
+}
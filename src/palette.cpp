@@ -1,51 +1,44 @@
 #include <array>
+#include <cstdint>
 #include <string>
-
-extern "C"
-{
-#include <lua.h>
-#include <lauxlib.h>
-#include <lualib.h>
-}
+#include <vector>
 
 namespace chip8{
     class chip8_palette{
         private:
-            std::string type = "";
+            enum class palette_type{chip8, chip8x, xochip};
+
+            palette_type type = palette_type::chip8;
             std::vector<std::array<uint8_t, 3>> colors;
 
-            /**
-             * @brief load a color from the table at the top of the stack
-             * 
-             * @param L lua state
-             * @param color the target color
-             * @param index index of the color in the table
-             */
-            void load_color(lua_State *L, std::array<uint8_t, 3> &color, int index){
-                lua_geti(L, -1, index);
-                if(lua_istable(L, -1)){
-                    for(int i = 1; i < 4; i++){
-                        lua_geti(L, -1, i);
-                        if(lua_isinteger(L, -1)) color.at(i - 1) = lua_tointeger(L, -1);
-                        lua_pop(L, 1);
+            /// colors indexed by the pixel bits of plane 0 (bit 0) and plane 1 (bit 1)
+            std::array<std::array<uint8_t, 3>, 4> plane_colors;
+            /// number of planes that select a color in plane_colors
+            unsigned int color_planes = 1;
+            /// CHIP-8X background colors indexed by the background color register
+            std::array<std::array<uint8_t, 3>, 4> chip8x_bg_colors;
+
+            /// every byte with bit n (counted from the most significant bit) moved to the lowest bit of byte n
+            static constexpr std::array<uint64_t, 256> spread_bits = []{
+                std::array<uint64_t, 256> table{};
+                for(unsigned int byte = 0; byte < 256; byte++){
+                    for(unsigned int bit = 0; bit < 8; bit++){
+                        if(byte & (0x80 >> bit)) table[byte] |= uint64_t(1) << (bit * 8);
                     }
                 }
-                lua_pop(L, 1);
-            }
+                return table;
+            }();
 
         public:
-            void load_config(lua_State *L){
-                lua_getfield(L, -1, "palette");
-
-                // get palette type
-                if(lua_istable(L, -1)){
-                    lua_getfield(L, -1, "type");
-                    type = lua_isstring(L, -1) ? lua_tostring(L, -1) : "";
-                    lua_pop(L, 1);
+            void load_config(const mode_config &m){
+                if(m.palette_type == "chip8x"){
+                    type = palette_type::chip8x;
+                }else if(m.palette_type == "xochip"){
+                    type = palette_type::xochip;
                 }
 
                 // set default colors
-                if(type == "chip8x"){
+                if(type == palette_type::chip8x){
                     colors = {
                         {0x00, 0x00, 0x00}, // black
                         {0xff, 0x00, 0x00}, // red
@@ -56,7 +49,7 @@ namespace chip8{
                         {0x00, 0xff, 0xff}, // aqua
                         {0xff, 0xff, 0xff}, // white
                     };
-                }else if(type == "xochip"){
+                }else if(type == palette_type::xochip){
                     colors = {
                         {0x00, 0x00, 0x00},
                         {0x00, 0xff, 0x00},
@@ -71,77 +64,99 @@ namespace chip8{
                 }
 
                 // load colors from config
-                if(lua_istable(L, -1)){
-                    for(size_t i = 0; i < colors.size(); i++){
-                        load_color(L, colors.at(i), i+1);
+                for(size_t i = 0; i < colors.size(); i++){
+                    for(size_t j = 0; j < 3; j++){
+                        if(m.palette_colors.at(i).at(j) >= 0) colors.at(i).at(j) = m.palette_colors.at(i).at(j);
                     }
                 }
 
-                lua_pop(L, 1);
+                // lookup tables
+                if(type == palette_type::xochip){
+                    plane_colors = {colors.at(0), colors.at(1), colors.at(2), colors.at(3)};
+                    color_planes = 2;
+                }else{
+                    plane_colors = {colors.at(0), colors.at(1), colors.at(0), colors.at(1)};
+                    color_planes = 1;
+                }
+                if(type == palette_type::chip8x){
+                    chip8x_bg_colors = {colors.at(2), colors.at(0), colors.at(4), colors.at(1)};
+                }
             }
 
-            template<class hardware> std::array<uint8_t, 3> color_chip8(hardware hw, int x, int y){
-                if(hw->screen_content.at(0).at(y).at(x)){
-                    return colors.at(1);
+            /// returns the color of the pixel at (x, y)
+            template<class hardware> std::array<uint8_t, 3> color(hardware hw, int x, int y){
+                if(type == palette_type::chip8x){
+                    if(hw->screen_get(0, x, y)){
+                        return colors.at(hw->screen_fg_color.at(y).at(x));
+                    }
+                    return bg_color(hw);
                 }
-                return colors.at(0);
-            }
 
-            template<class hardware> std::array<uint8_t, 3> color_chip8x(hardware hw, int x, int y){
-                if(hw->screen_content.at(0).at(y).at(x)){
-                    return colors.at(hw->screen_fg_color.at(y).at(x));
+                unsigned int index = 0;
+                for(unsigned int plane = 0; plane < color_planes; plane++){
+                    index |= hw->screen_get(plane, x, y) << plane;
                 }
-                return bg_color_chip8x(hw);
+                return plane_colors[index];
             }
 
-            template<class hardware> std::array<uint8_t, 3> color_xochip(hardware hw, int x, int y){
-                if(hw->screen_content.at(0).at(y).at(x) && !hw->screen_content.at(1).at(y).at(x)){
-                    return colors.at(1);
-                }else if(!hw->screen_content.at(0).at(y).at(x) && hw->screen_content.at(1).at(y).at(x)){
-                    return colors.at(2);
-                }else if(hw->screen_content.at(0).at(y).at(x) && hw->screen_content.at(1).at(y).at(x)){
-                    return colors.at(3);
+            /// returns the background color for the whole screen
+            template<class hardware> std::array<uint8_t, 3> bg_color(hardware hw){
+                if(type == palette_type::chip8x){
+                    return chip8x_bg_colors[hw->screen_bg_color % 4];
                 }
-                return colors.at(0);
+                return plane_colors[0];
             }
 
-            template<class hardware> std::array<uint8_t, 3> bg_color_chip8(hardware hw){
-                (void)hw;
-                return colors.at(0);
-            }
+            /**
+             * @brief convert a part of a screen row to colors
+             *
+             * Aligned groups of 8 pixels are converted at once: the plane bits of a byte are spread
+             * into one byte per pixel, which gives 8 lookup table indices in a single word.
+             * @param out receives width colors
+             */
+            template<class hardware> void convert_row(hardware hw, size_t x, size_t y, size_t width, std::array<uint8_t, 3> *out){
+                const uint64_t *plane_0 = hw->screen_row(0, y);
 
-            template<class hardware> std::array<uint8_t, 3> bg_color_chip8x(hardware hw){
-                switch(hw->screen_bg_color){
-                    case 1: return colors.at(0); break;
-                    case 2: return colors.at(4); break;
-                    case 3: return colors.at(1); break;
-                    default: return colors.at(2);
+                if(type == palette_type::chip8x){
+                    const auto &fg_colors = hw->screen_fg_color.at(y);
+                    const std::array<uint8_t, 3> background = bg_color(hw);
+
+                    for(size_t i = 0; i < width; i++){
+                        size_t column = x + i;
+                        bool set = (plane_0[column / 64] >> (63 - column % 64)) & 1;
+                        out[i] = set ? colors.at(fg_colors[column]) : background;
+                    }
+                    return;
                 }
-            }
 
-            template<class hardware> std::array<uint8_t, 3> bg_color_xochip(hardware hw){
-                (void)hw;
-                return colors.at(0);
-            }
+                const uint64_t *plane_1 = color_planes > 1 ? hw->screen_row(1, y) : nullptr;
 
-            /// returns the color of the pixel at (x, y)
-            template<class hardware> std::array<uint8_t, 3> color(hardware hw, int x, int y){
-                if(type == "chip8x"){
-                    return color_chip8x(hw, x, y);
-                }else if(type == "xochip"){
-                    return color_xochip(hw, x, y);
+                for(size_t i = 0; i < width;){
+                    size_t column = x + i;
+
+                    if(column % 8 == 0 && width - i >= 8){
+                        unsigned int shift = 56 - column % 64;
+                        uint64_t indices = spread_bits[(plane_0[column / 64] >> shift) & 0xff];
+                        if(plane_1) indices |= spread_bits[(plane_1[column / 64] >> shift) & 0xff] << 1;
+
+                        for(unsigned int pixel = 0; pixel < 8; pixel++){
+                            out[i + pixel] = plane_colors[(indices >> (pixel * 8)) & 0x03];
+                        }
+                        i += 8;
+                    }else{
+                        unsigned int shift = 63 - column % 64;
+                        unsigned int index = (plane_0[column / 64] >> shift) & 1;
+                        if(plane_1) index |= ((plane_1[column / 64] >> shift) & 1) << 1;
+
+                        out[i] = plane_colors[index];
+                        i++;
+                    }
                 }
-                return color_chip8(hw, x, y);
             }
 
-            /// returns the background color for the whole screen
-            template<class hardware> std::array<uint8_t, 3> bg_color(hardware hw){
-                if(type == "chip8x"){
-                    return bg_color_chip8x(hw);
-                }else if(type == "xochip"){
-                    return bg_color_xochip(hw);
-                }
-                return bg_color_chip8(hw);
+            /// returns true if the color of a pixel depends on its position and not only on its planes
+            bool position_dependent(){
+                return type == palette_type::chip8x;
             }
     };
 }
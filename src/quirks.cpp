@@ -1,6 +1,29 @@
+#include <cstdint>
 #include <iostream>
 
 namespace chip8{
+    /// one bit per quirk, used to describe a set of quirks at compile time
+    namespace quirk_flags{
+        constexpr uint32_t quirk_bnnn_bxnn_use_vx = 1u << 0;
+        constexpr uint32_t quirk_fx55_fx65_increment_less = 1u << 1;
+        constexpr uint32_t quirk_fx55_fx65_no_increment = 1u << 2;
+        constexpr uint32_t quirk_8xy6_8xye_shift_vx = 1u << 3;
+        constexpr uint32_t quirk_dxy0_16x16_highres = 1u << 4;
+        constexpr uint32_t quirk_dxy0_16x16_lowres = 1u << 5;
+        constexpr uint32_t quirk_dxy0_8x16_lowres = 1u << 6;
+        constexpr uint32_t quirk_fx29_digits_highres = 1u << 7;
+        constexpr uint32_t quirk_dxyn_count_collisions_highres = 1u << 8;
+        constexpr uint32_t quirk_dxyn_no_wrapping = 1u << 9;
+        constexpr uint32_t quirk_fx55_fx65_use_rd0 = 1u << 10;
+        constexpr uint32_t quirk_bnnn_use_rd0 = 1u << 11;
+        constexpr uint32_t quirk_fx75_fx85_allow_all = 1u << 12;
+        constexpr uint32_t quirk_00fe_00ff_clear_screen = 1u << 13;
+        constexpr uint32_t quirk_fx1e_set_vf = 1u << 14;
+        constexpr uint32_t quirk_fx1e_overflow_at_memory_size = 1u << 15;
+        constexpr uint32_t quirk_00fe_00ff_clear_all_planes = 1u << 16;
+        constexpr uint32_t quirk_lowres_double_scroll = 1u << 17;
+    }
+
     /** The available quirks.
     These change the emulation behaviour.
     */
@@ -45,84 +68,48 @@ namespace chip8{
 
             bool override_fx55_fx65_no_increment = false;
 
-            explicit chip8_quirks(lua_State *L){
-                override_fx55_fx65_no_increment = false;
-
-                lua_getfield(L, -1, "quirks");
-                if(lua_istable(L, -1)){
-                    lua_getfield(L, -1, "bnnn_bxnn_use_vx");
-                    quirk_bnnn_bxnn_use_vx = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "fx55_fx65_increment_less");
-                    quirk_fx55_fx65_increment_less = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "fx55_fx65_no_increment");
-                    quirk_fx55_fx65_no_increment = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "8xy6_8xye_shift_vx");
-                    quirk_8xy6_8xye_shift_vx = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "dxy0_16x16_highres");
-                    quirk_dxy0_16x16_highres = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "dxy0_16x16_lowres");
-                    quirk_dxy0_16x16_lowres = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "dxy0_8x16_lowres");
-                    quirk_dxy0_8x16_lowres = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "fx29_digits_highres");
-                    quirk_fx29_digits_highres = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "dxyn_count_collisions_highres");
-                    quirk_dxyn_count_collisions_highres = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "dxyn_no_wrapping");
-                    quirk_dxyn_no_wrapping = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "fx55_fx65_use_rd0");
-                    quirk_fx55_fx65_use_rd0 = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "bnnn_use_rd0");
-                    quirk_bnnn_use_rd0 = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "fx75_fx85_allow_all");
-                    quirk_fx75_fx85_allow_all = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "00fe_00ff_clear_screen");
-                    quirk_00fe_00ff_clear_screen = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "fx1e_set_vf");
-                    quirk_fx1e_set_vf = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "fx1e_overflow_at_memory_size");
-                    quirk_fx1e_overflow_at_memory_size = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-
-                    lua_getfield(L, -1, "00fe_00ff_clear_all_planes");
-                    quirk_00fe_00ff_clear_all_planes = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
+            /// @param flags the quirks as a combination of quirk_flags
+            explicit chip8_quirks(uint32_t flags){
+                quirk_bnnn_bxnn_use_vx = flags & quirk_flags::quirk_bnnn_bxnn_use_vx;
+                quirk_fx55_fx65_increment_less = flags & quirk_flags::quirk_fx55_fx65_increment_less;
+                quirk_fx55_fx65_no_increment = flags & quirk_flags::quirk_fx55_fx65_no_increment;
+                quirk_8xy6_8xye_shift_vx = flags & quirk_flags::quirk_8xy6_8xye_shift_vx;
+                quirk_dxy0_16x16_highres = flags & quirk_flags::quirk_dxy0_16x16_highres;
+                quirk_dxy0_16x16_lowres = flags & quirk_flags::quirk_dxy0_16x16_lowres;
+                quirk_dxy0_8x16_lowres = flags & quirk_flags::quirk_dxy0_8x16_lowres;
+                quirk_fx29_digits_highres = flags & quirk_flags::quirk_fx29_digits_highres;
+                quirk_dxyn_count_collisions_highres = flags & quirk_flags::quirk_dxyn_count_collisions_highres;
+                quirk_dxyn_no_wrapping = flags & quirk_flags::quirk_dxyn_no_wrapping;
+                quirk_fx55_fx65_use_rd0 = flags & quirk_flags::quirk_fx55_fx65_use_rd0;
+                quirk_bnnn_use_rd0 = flags & quirk_flags::quirk_bnnn_use_rd0;
+                quirk_fx75_fx85_allow_all = flags & quirk_flags::quirk_fx75_fx85_allow_all;
+                quirk_00fe_00ff_clear_screen = flags & quirk_flags::quirk_00fe_00ff_clear_screen;
+                quirk_fx1e_set_vf = flags & quirk_flags::quirk_fx1e_set_vf;
+                quirk_fx1e_overflow_at_memory_size = flags & quirk_flags::quirk_fx1e_overflow_at_memory_size;
+                quirk_00fe_00ff_clear_all_planes = flags & quirk_flags::quirk_00fe_00ff_clear_all_planes;
+                quirk_lowres_double_scroll = flags & quirk_flags::quirk_lowres_double_scroll;
+            }
 
-                    lua_getfield(L, -1, "lowres_double_scroll");
-                    quirk_lowres_double_scroll = lua_isboolean(L, -1) ? lua_toboolean(L, -1) : false;
-                    lua_pop(L, 1);
-                }
-                lua_pop(L, 1);
+            /// returns the quirks as a combination of quirk_flags
+            uint32_t flags() const{
+                return (quirk_bnnn_bxnn_use_vx ? quirk_flags::quirk_bnnn_bxnn_use_vx : 0)
+                | (quirk_fx55_fx65_increment_less ? quirk_flags::quirk_fx55_fx65_increment_less : 0)
+                | (quirk_fx55_fx65_no_increment ? quirk_flags::quirk_fx55_fx65_no_increment : 0)
+                | (quirk_8xy6_8xye_shift_vx ? quirk_flags::quirk_8xy6_8xye_shift_vx : 0)
+                | (quirk_dxy0_16x16_highres ? quirk_flags::quirk_dxy0_16x16_highres : 0)
+                | (quirk_dxy0_16x16_lowres ? quirk_flags::quirk_dxy0_16x16_lowres : 0)
+                | (quirk_dxy0_8x16_lowres ? quirk_flags::quirk_dxy0_8x16_lowres : 0)
+                | (quirk_fx29_digits_highres ? quirk_flags::quirk_fx29_digits_highres : 0)
+                | (quirk_dxyn_count_collisions_highres ? quirk_flags::quirk_dxyn_count_collisions_highres : 0)
+                | (quirk_dxyn_no_wrapping ? quirk_flags::quirk_dxyn_no_wrapping : 0)
+                | (quirk_fx55_fx65_use_rd0 ? quirk_flags::quirk_fx55_fx65_use_rd0 : 0)
+                | (quirk_bnnn_use_rd0 ? quirk_flags::quirk_bnnn_use_rd0 : 0)
+                | (quirk_fx75_fx85_allow_all ? quirk_flags::quirk_fx75_fx85_allow_all : 0)
+                | (quirk_00fe_00ff_clear_screen ? quirk_flags::quirk_00fe_00ff_clear_screen : 0)
+                | (quirk_fx1e_set_vf ? quirk_flags::quirk_fx1e_set_vf : 0)
+                | (quirk_fx1e_overflow_at_memory_size ? quirk_flags::quirk_fx1e_overflow_at_memory_size : 0)
+                | (quirk_00fe_00ff_clear_all_planes ? quirk_flags::quirk_00fe_00ff_clear_all_planes : 0)
+                | (quirk_lowres_double_scroll ? quirk_flags::quirk_lowres_double_scroll : 0);
             }
 
             /// Print the quirks to outstream
@@ -148,4 +135,54 @@ namespace chip8{
                 << "lowres_double_scroll            " << (quirk_lowres_double_scroll ? "true\n" : "false\n");
             }
     };
-}
\ No newline at end of file
+
+    /** A set of quirks that is known at compile time.
+    The static members hide the runtime members of chip8_quirks, so that the interpreter can drop the branches of disabled quirks.
+    The quirks read from the mode must match (see flags()).
+    */
+    template<uint32_t quirks> class chip8_quirks_fixed : public chip8_quirks{
+        public:
+            static constexpr uint32_t fixed_flags = quirks;
+
+            static constexpr bool quirk_bnnn_bxnn_use_vx = quirks & quirk_flags::quirk_bnnn_bxnn_use_vx;
+            static constexpr bool quirk_fx55_fx65_increment_less = quirks & quirk_flags::quirk_fx55_fx65_increment_less;
+            static constexpr bool quirk_fx55_fx65_no_increment = quirks & quirk_flags::quirk_fx55_fx65_no_increment;
+            static constexpr bool quirk_8xy6_8xye_shift_vx = quirks & quirk_flags::quirk_8xy6_8xye_shift_vx;
+            static constexpr bool quirk_dxy0_16x16_highres = quirks & quirk_flags::quirk_dxy0_16x16_highres;
+            static constexpr bool quirk_dxy0_16x16_lowres = quirks & quirk_flags::quirk_dxy0_16x16_lowres;
+            static constexpr bool quirk_dxy0_8x16_lowres = quirks & quirk_flags::quirk_dxy0_8x16_lowres;
+            static constexpr bool quirk_fx29_digits_highres = quirks & quirk_flags::quirk_fx29_digits_highres;
+            static constexpr bool quirk_dxyn_count_collisions_highres = quirks & quirk_flags::quirk_dxyn_count_collisions_highres;
+            static constexpr bool quirk_dxyn_no_wrapping = quirks & quirk_flags::quirk_dxyn_no_wrapping;
+            static constexpr bool quirk_fx55_fx65_use_rd0 = quirks & quirk_flags::quirk_fx55_fx65_use_rd0;
+            static constexpr bool quirk_bnnn_use_rd0 = quirks & quirk_flags::quirk_bnnn_use_rd0;
+            static constexpr bool quirk_fx75_fx85_allow_all = quirks & quirk_flags::quirk_fx75_fx85_allow_all;
+            static constexpr bool quirk_00fe_00ff_clear_screen = quirks & quirk_flags::quirk_00fe_00ff_clear_screen;
+            static constexpr bool quirk_fx1e_set_vf = quirks & quirk_flags::quirk_fx1e_set_vf;
+            static constexpr bool quirk_fx1e_overflow_at_memory_size = quirks & quirk_flags::quirk_fx1e_overflow_at_memory_size;
+            static constexpr bool quirk_00fe_00ff_clear_all_planes = quirks & quirk_flags::quirk_00fe_00ff_clear_all_planes;
+            static constexpr bool quirk_lowres_double_scroll = quirks & quirk_flags::quirk_lowres_double_scroll;
+
+            explicit chip8_quirks_fixed(uint32_t flags) : chip8_quirks(flags){}
+    };
+
+    using quirks_chip8 = chip8_quirks_fixed<0>;
+    using quirks_chip48 = chip8_quirks_fixed<
+        quirk_flags::quirk_bnnn_bxnn_use_vx | quirk_flags::quirk_fx55_fx65_increment_less |
+        quirk_flags::quirk_8xy6_8xye_shift_vx | quirk_flags::quirk_dxyn_no_wrapping>;
+    using quirks_schip10 = chip8_quirks_fixed<
+        quirk_flags::quirk_bnnn_bxnn_use_vx | quirk_flags::quirk_fx55_fx65_increment_less |
+        quirk_flags::quirk_8xy6_8xye_shift_vx | quirk_flags::quirk_dxyn_no_wrapping |
+        quirk_flags::quirk_dxy0_16x16_highres | quirk_flags::quirk_dxy0_8x16_lowres | quirk_flags::quirk_fx29_digits_highres>;
+    using quirks_schip11 = chip8_quirks_fixed<
+        quirk_flags::quirk_bnnn_bxnn_use_vx | quirk_flags::quirk_fx55_fx65_no_increment |
+        quirk_flags::quirk_8xy6_8xye_shift_vx | quirk_flags::quirk_dxyn_no_wrapping |
+        quirk_flags::quirk_dxy0_16x16_highres | quirk_flags::quirk_dxy0_8x16_lowres | quirk_flags::quirk_dxyn_count_collisions_highres>;
+    using quirks_schpc = chip8_quirks_fixed<quirk_flags::quirk_dxy0_16x16_highres>;
+    using quirks_xochip = chip8_quirks_fixed<
+        quirk_flags::quirk_dxy0_16x16_highres | quirk_flags::quirk_dxy0_16x16_lowres | quirk_flags::quirk_fx75_fx85_allow_all |
+        quirk_flags::quirk_00fe_00ff_clear_screen | quirk_flags::quirk_00fe_00ff_clear_all_planes>;
+    using quirks_octo = chip8_quirks_fixed<
+        quirk_flags::quirk_dxy0_16x16_highres | quirk_flags::quirk_dxy0_16x16_lowres | quirk_flags::quirk_fx75_fx85_allow_all |
+        quirk_flags::quirk_00fe_00ff_clear_screen | quirk_flags::quirk_00fe_00ff_clear_all_planes | quirk_flags::quirk_lowres_double_scroll>;
+}
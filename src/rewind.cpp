@@ -0,0 +1,188 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace chip8{
+    /** The history of a machine for rewinding, one snapshot (a save state) per frame.
+    Only the newest snapshot is kept whole. Every older frame is stored as the XOR of two neighbouring
+    snapshots, run length encoded, which is small because a frame changes few bytes of the machine.
+    The deltas live in a ring buffer of a fixed number of bytes, the oldest frames are dropped when it is full.
+    A snapshot can be pushed in two parts, e.g. a save state header and the live machine_state, so it is never copied as a whole.
+    */
+    class rewind_buffer{
+        public:
+            /// @param budget bytes for the deltas, the newest snapshot, a copy for step_back() and the encoding buffer come on top
+            explicit rewind_buffer(size_t budget) : ring(budget){}
+
+            /// add a snapshot as the newest frame
+            void push(std::span<const uint8_t> snapshot){
+                push(snapshot, {});
+            }
+
+            /// add the snapshot made of header followed by state as the newest frame
+            void push(std::span<const uint8_t> header, std::span<const uint8_t> state){
+                if(newest.size() != header.size() + state.size()){
+                    clear();
+                    newest.assign(header.begin(), header.end());
+                    newest.insert(newest.end(), state.begin(), state.end());
+                    return;
+                }
+
+                delta.clear();
+                size_t last = 0;
+                encode_delta(header, 0, last);
+                encode_delta(state, header.size(), last);
+                store(delta);
+            }
+
+            /**
+             * @brief go back one frame
+             *
+             * @param snapshot receives the snapshot of the previous frame
+             * @return false if there is no older frame
+             */
+            bool step_back(std::vector<uint8_t> &snapshot){
+                if(entries.empty()) return false;
+
+                const entry &e = entries.back();
+                delta.resize(e.size);
+                size_t first = std::min(e.size, ring.size() - e.offset);
+                std::memcpy(delta.data(), ring.data() + e.offset, first);
+                std::memcpy(delta.data() + first, ring.data(), e.size - first);
+                used -= e.size;
+                entries.pop_back();
+
+                apply_delta(delta, newest);
+                snapshot = newest;
+                return true;
+            }
+
+            /// number of frames that can be rewound
+            size_t frames() const{
+                return entries.size();
+            }
+
+            /// bytes of the ring buffer in use
+            size_t get_used() const{
+                return used;
+            }
+
+            void clear(){
+                entries.clear();
+                used = 0;
+                newest.clear();
+            }
+
+        private:
+            /// a delta in the ring buffer, it may wrap around the end
+            struct entry{
+                size_t offset, size;
+            };
+
+            std::vector<uint8_t> ring;
+            /// the deltas from the oldest to the newest frame
+            std::deque<entry> entries;
+            size_t used = 0;
+            std::vector<uint8_t> newest;
+            /// reused for encoding and decoding
+            std::vector<uint8_t> delta;
+
+            /// copy a delta into the ring buffer, dropping the oldest deltas to make room
+            void store(const std::vector<uint8_t> &data){
+                if(data.size() > ring.size()){
+                    // a single frame doesn't fit, the history can't go back past it
+                    entries.clear();
+                    used = 0;
+                    return;
+                }
+
+                while(ring.size() - used < data.size()){
+                    used -= entries.front().size;
+                    entries.pop_front();
+                }
+
+                size_t offset = entries.empty() ? 0 : (entries.back().offset + entries.back().size) % ring.size();
+                size_t first = std::min(data.size(), ring.size() - offset);
+                std::memcpy(ring.data() + offset, data.data(), first);
+                std::memcpy(ring.data(), data.data() + first, data.size() - first);
+
+                entries.push_back({offset, data.size()});
+                used += data.size();
+            }
+
+            static void write_varint(std::vector<uint8_t> &out, size_t value){
+                while(value >= 0x80){
+                    out.push_back(static_cast<uint8_t>(value) | 0x80);
+                    value >>= 7;
+                }
+                out.push_back(static_cast<uint8_t>(value));
+            }
+
+            static size_t read_varint(const std::vector<uint8_t> &in, size_t &position){
+                size_t value = 0;
+                for(unsigned int shift = 0; position < in.size(); shift += 7){
+                    uint8_t byte = in[position++];
+                    value |= size_t(byte & 0x7f) << shift;
+                    if(!(byte & 0x80)) return value;
+                }
+                throw std::runtime_error("damaged rewind delta");
+            }
+
+            /**
+             * @brief append the XOR of part and the bytes of newest at base to delta, then copy the changes into newest
+             *
+             * The delta is a list of runs of (unchanged bytes, changed bytes, XOR of the changed bytes).
+             * Equal bytes are skipped 8 at a time, a run of changed bytes ends at 8 equal bytes.
+             * @param last end of the previous run in newest, updated for the next part
+             */
+            void encode_delta(std::span<const uint8_t> part, size_t base, size_t &last){
+                const uint8_t *a = part.data();
+                uint8_t *b = newest.data() + base;
+                const size_t n = part.size();
+                size_t position = 0;
+
+                while(position < n){
+                    while(position + 8 <= n && std::memcmp(a + position, b + position, 8) == 0) position += 8;
+                    while(position < n && a[position] == b[position]) position++;
+                    if(position == n) break;
+
+                    size_t start = position, end = position;
+                    while(position < n && position - end < 8){
+                        if(a[position] != b[position]) end = position + 1;
+                        position++;
+                    }
+
+                    write_varint(delta, base + start - last);
+                    write_varint(delta, end - start);
+                    for(size_t i = start; i < end; i++){
+                        delta.push_back(a[i] ^ b[i]);
+                        b[i] = a[i];
+                    }
+                    last = base + end;
+                    position = end;
+                }
+            }
+
+            /// XOR an encoded delta into data
+            static void apply_delta(const std::vector<uint8_t> &in, std::vector<uint8_t> &data){
+                size_t position = 0, target = 0;
+                while(position < in.size()){
+                    target += read_varint(in, position);
+                    size_t length = read_varint(in, position);
+                    if(target + length > data.size() || position + length > in.size()){
+                        throw std::runtime_error("damaged rewind delta");
+                    }
+                    for(size_t i = 0; i < length; i++){
+                        data[target + i] ^= in[position + i];
+                    }
+                    target += length;
+                    position += length;
+                }
+            }
+    };
+}
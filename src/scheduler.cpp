@@ -0,0 +1,81 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+
+namespace chip8{
+    /** Paces the emulation in fixed frames.
+    The host thread sleeps until shortly before the deadline and spins for the rest,
+    so a frame ends on time without one timer wake-up per instruction.
+    */
+    class frame_scheduler{
+        public:
+            using clock = std::chrono::steady_clock;
+
+            /**
+             * @param frame_duration time between two frames
+             * @param spin_duration the last part of the wait is spent spinning instead of sleeping
+             */
+            frame_scheduler(clock::duration frame_duration, clock::duration spin_duration = std::chrono::milliseconds(1)) :
+                frame_duration(frame_duration), spin_duration(spin_duration){
+                start();
+            }
+
+            /// start counting frames from now
+            void start(){
+                deadline = clock::now() + frame_duration;
+            }
+
+            /// wait until the end of the current frame and record how late the wake-up was
+            void wait(){
+                if(clock::now() < deadline - spin_duration){
+                    std::this_thread::sleep_until(deadline - spin_duration);
+                }
+                while(clock::now() < deadline){
+                    std::this_thread::yield();
+                }
+
+                clock::time_point now = clock::now();
+                double jitter = std::chrono::duration<double, std::micro>(now - deadline).count();
+                frames++;
+                jitter_sum += jitter;
+                jitter_square_sum += jitter * jitter;
+                jitter_max = std::max(jitter_max, jitter);
+
+                deadline += frame_duration;
+
+                // don't try to catch up after a long stall
+                if(now > deadline){
+                    late_frames++;
+                    deadline = now + frame_duration;
+                }
+            }
+
+            /// print the frame pacing statistics
+            void print(std::ostream &outstream){
+                double mean = frames ? jitter_sum / frames : 0;
+                double deviation = frames ? std::sqrt(std::max(0.0, jitter_square_sum / frames - mean * mean)) : 0;
+
+                outstream
+                    << "frames                          " << frames << "\n"
+                    << "late frames                     " << late_frames << "\n"
+                    << "jitter mean                     " << mean << " us\n"
+                    << "jitter standard deviation       " << deviation << " us\n"
+                    << "jitter max                      " << jitter_max << " us\n";
+            }
+
+        private:
+            clock::duration frame_duration;
+            clock::duration spin_duration;
+            clock::time_point deadline;
+
+            // frame pacing statistics
+            uint64_t frames = 0;
+            uint64_t late_frames = 0;
+            double jitter_sum = 0;
+            double jitter_square_sum = 0;
+            double jitter_max = 0;
+    };
+}
@@ -0,0 +1,418 @@
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <algorithm>
+
+#include "interpreter.cpp"
+#include "audio.cpp"
+#include "frontend_headless.cpp"
+
+extern "C"
+{
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+}
+
+/** Decoder equivalence test.
+Decodes every opcode in every mode with a copy of the if/else cascade of the original execute() and compares it
+with the cascade decoder and the dispatch table, of the generic instruction set and of the specialization chip8 runs the mode with.
+Then executes every opcode on each of these interpreters, starting from the same state, and compares the resulting machine states and errors.
+*/
+
+/**
+ * @brief the operation an opcode ran in the original execute(), which tested each extension in this order
+ *
+ * Kept as it was, so that the decoders are checked against the behaviour they replaced and not against themselves.
+ */
+chip8::operation reference_decode(uint32_t flags, uint16_t opcode){
+    using chip8::operation;
+    namespace is = chip8::instruction_set_flags;
+
+    uint8_t high = opcode >> 8, low = opcode & 0xff;
+    uint8_t high_h = (high >> 4), low_h = low >> 4, low_l = low & 0x0f;
+
+    if(flags & is::chip8e){
+        if(opcode == 0x00ed) return operation::op_00ed_chip8e;
+        else if(opcode == 0x00f2) return operation::op_00f2_chip8e;
+        else if(opcode == 0x0151) return operation::op_0151_chip8e;
+        else if(opcode == 0x0188) return operation::op_0188_chip8e;
+        else if(high_h == 0x05 && low_l == 0x01) return operation::op_5xy1_chip8e;
+        else if(high_h == 0x05 && low_l == 0x02) return operation::op_5xy2_chip8e;
+        else if(high_h == 0x05 && low_l == 0x03) return operation::op_5xy3_chip8e;
+        else if(high == 0xbb) return operation::op_bbnn_chip8e;
+        else if(high == 0xbf) return operation::op_bfnn_chip8e;
+        else if(high_h == 0x0f && low == 0x03) return operation::op_fx03_chip8e;
+        else if(high_h == 0x0f && low == 0x1b) return operation::op_fx1b_chip8e;
+        else if(high_h == 0x0f && low == 0x4f) return operation::op_fx4f_chip8e;
+        else if(high_h == 0x0f && low == 0xe3) return operation::op_fxe3_chip8e;
+        else if(high_h == 0x0f && low == 0xe7) return operation::op_fxe7_chip8e;
+    }
+
+    if(flags & is::super_chip_1_0){
+        if(opcode == 0x00fd) return operation::op_00fd_schip10;
+        else if(opcode == 0x00fe) return operation::op_00fe_schip10;
+        else if(opcode == 0x00ff) return operation::op_00ff_schip10;
+        else if(high_h == 0x0f && low == 0x75) return operation::op_fx75_schip10;
+        else if(high_h == 0x0f && low == 0x85) return operation::op_fx85_schip10;
+    }
+
+    if(flags & is::super_chip_1_1){
+        if(high == 0x00 && low_h == 0x0c) return operation::op_00cn_schip11;
+        else if(opcode == 0x00fb) return operation::op_00fb_schip11;
+        else if(opcode == 0x00fc) return operation::op_00fc_schip11;
+        else if(high_h == 0x0f && low == 0x30) return operation::op_fx30_schip11;
+    }
+
+    if(flags & is::set_rd0_fxf2){
+        if(high_h == 0x0f && low == 0xf2) return operation::op_fxf2;
+    }
+
+    if(flags & is::scroll_up_00bn){
+        if(high_h == 0x00 && low_h == 0x0b) return operation::op_00bn;
+    }
+
+    if(flags & is::chip8x){
+        if(opcode == 0x02a0) return operation::op_02a0_chip8x;
+        else if(high_h == 0x05 && low_l == 0x01) return operation::op_5xy1_chip8x;
+        else if(high_h == 0x0b && low_l == 0x00) return operation::op_bxy0_chip8x;
+        else if(high_h == 0x0b) return operation::op_bxyn_chip8x;
+        else if(high_h == 0x0e && low == 0xf2) return operation::op_exf2_chip8x;
+        else if(high_h == 0x0e && low == 0xf5) return operation::op_exf5_chip8x;
+        else if(high_h == 0x0f && low == 0xf8) return operation::op_fxf8_chip8x;
+        else if(high_h == 0x0f && low == 0xfb) return operation::op_fxfb_chip8x;
+    }
+
+    if(flags & is::xochip){
+        if(high == 0x00 && low_h == 0x0d) return operation::op_00dn_xochip;
+        else if(high_h == 0x05 && low_l == 0x02) return operation::op_5xy2_xochip;
+        else if(high_h == 0x05 && low_l == 0x03) return operation::op_5xy3_xochip;
+        else if(opcode == 0xf000) return operation::op_f000_xochip;
+        else if(high_h == 0x0f && low == 0x01) return operation::op_fn01_xochip;
+        else if(opcode == 0xf002) return operation::op_f002_xochip;
+        else if(high_h == 0x0f && low == 0x3a) return operation::op_fx3a_xochip;
+    }
+
+    if(flags & is::stop_0000){
+        if(opcode == 0x0000) return operation::op_0000;
+    }
+
+    if(flags & is::chip8run){
+        if(high == 0x00 && low_h == 0x01) return operation::op_001n_chip8run;
+        else if(opcode == 0x00fa) return operation::op_00fa_chip8run;
+    }
+
+    if(flags & is::eti660){
+        if(high_h == 0x0f && low == 0x00) return operation::op_fx00_eti660;
+        else if(opcode == 0x00f8) return operation::op_00f8_eti660;
+        else if(opcode == 0x00fc) return operation::op_00fc_eti660;
+        else if(opcode == 0x0ff) return operation::op_00ff_eti660;
+    }
+
+    if(flags & is::eti660color){
+        if(opcode == 0x07a2) return operation::op_07a2_eti660color;
+        else if(opcode == 0x07c1) return operation::op_07c1_eti660color;
+        else if(opcode == 0x27ab) return operation::op_27ab_eti660color;
+    }
+
+    if(flags & is::eti660color_highres){
+        if(opcode == 0x049f) return operation::op_049f_eti660color_highres;
+        else if(opcode == 0x04a2) return operation::op_04a2_eti660color_highres;
+        else if(opcode == 0x04b2) return operation::op_04b2_eti660color_highres;
+    }
+
+    if(flags & is::chip8elf){
+        if(high_h == 0x05 && low_l == 0x01) return operation::op_5xy1_chip8elf;
+        else if(high_h == 0x05 && low_l == 0x02) return operation::op_5xy2_chip8elf;
+        else if(high_h == 0x05 && low_l == 0x03) return operation::op_5xy3_chip8elf;
+        else if(high_h == 0x09 && low_l == 0x01) return operation::op_9xy1_chip8elf;
+        else if(high_h == 0x09 && low_l == 0x02) return operation::op_9xy2_chip8elf;
+        else if(high_h == 0x09 && low_l == 0x03) return operation::op_9xy3_chip8elf;
+        else if(high_h == 0x0f && low == 0x75) return operation::op_fx75_chip8elf;
+        else if(high_h == 0x0f && low == 0x94) return operation::op_fx94_chip8elf;
+        else if(high == 0xff && low == 0xff) return operation::op_ffff_chip8elf;
+    }
+
+    if(opcode == 0x00e0) return operation::op_00e0;
+    else if(opcode == 0x00ee) return operation::op_00ee;
+    else if(high_h == 0x00) return operation::op_0nnn;
+    else if(high_h == 0x01) return operation::op_1nnn;
+    else if(high_h == 0x02) return operation::op_2nnn;
+    else if(high_h == 0x03) return operation::op_3xnn;
+    else if(high_h == 0x04) return operation::op_4xnn;
+    else if(high_h == 0x05 && low_l == 0x00) return operation::op_5xy0;
+    else if(high_h == 0x06) return operation::op_6xnn;
+    else if(high_h == 0x07) return operation::op_7xnn;
+    else if(high_h == 0x08 && low_l == 0x00) return operation::op_8xy0;
+    else if(high_h == 0x08 && low_l == 0x01) return operation::op_8xy1;
+    else if(high_h == 0x08 && low_l == 0x02) return operation::op_8xy2;
+    else if(high_h == 0x08 && low_l == 0x03) return operation::op_8xy3;
+    else if(high_h == 0x08 && low_l == 0x04) return operation::op_8xy4;
+    else if(high_h == 0x08 && low_l == 0x05) return operation::op_8xy5;
+    else if(high_h == 0x08 && low_l == 0x06) return operation::op_8xy6;
+    else if(high_h == 0x08 && low_l == 0x07) return operation::op_8xy7;
+    else if(high_h == 0x08 && low_l == 0x0e) return operation::op_8xye;
+    else if(high_h == 0x09 && low_l == 0x00) return operation::op_9xy0;
+    else if(high_h == 0x0a) return operation::op_annn;
+    else if(high_h == 0x0b) return operation::op_bnnn;
+    else if(high_h == 0x0c) return operation::op_cxnn;
+    else if(high_h == 0x0d) return operation::op_dxyn;
+    else if(high_h == 0x0e && low == 0x9e) return operation::op_ex9e;
+    else if(high_h == 0x0e && low == 0xa1) return operation::op_exa1;
+    else if(high_h == 0x0f && low == 0x07) return operation::op_fx07;
+    else if(high_h == 0x0f && low == 0x0a) return operation::op_fx0a;
+    else if(high_h == 0x0f && low == 0x15) return operation::op_fx15;
+    else if(high_h == 0x0f && low == 0x18) return operation::op_fx18;
+    else if(high_h == 0x0f && low == 0x1e) return operation::op_fx1e;
+    else if(high_h == 0x0f && low == 0x29) return operation::op_fx29;
+    else if(high_h == 0x0f && low == 0x33) return operation::op_fx33;
+    else if(high_h == 0x0f && low == 0x55) return operation::op_fx55;
+    else if(high_h == 0x0f && low == 0x65) return operation::op_fx65;
+    return operation::unknown;
+}
+
+template<class instruction_set, class quirks> using interpreter_of = chip8::chip8_interpreter<instruction_set, quirks, chip8::chip8_hardware<chip8::chip8_palette>>;
+
+/// gives the test access to the state and the decoder of an interpreter
+template<class instruction_set, class quirks> class decoder_probe : public interpreter_of<instruction_set, quirks>{
+    public:
+        using interpreter_of<instruction_set, quirks>::interpreter_of;
+
+        /// bytes of machine_state up to the end of the used memory
+        size_t state_size() const{
+            return offsetof(chip8::machine_state, memory) + this->memory_size;
+        }
+
+        /// the machine and the interpreter state outside of it
+        std::vector<uint8_t> get_state() const{
+            std::vector<uint8_t> state(state_size() + 3);
+            std::memcpy(state.data(), static_cast<const chip8::machine_state *>(this), state_size());
+            state[state_size()] = this->skip_instruction;
+            state[state_size() + 1] = this->override_fx55_fx65_no_increment;
+            state[state_size() + 2] = this->cycles_to_tick;
+            return state;
+        }
+
+        void set_state(const std::vector<uint8_t> &state){
+            std::memcpy(static_cast<chip8::machine_state *>(this), state.data(), state_size());
+            this->skip_instruction = state[state_size()];
+            this->override_fx55_fx65_no_increment = state[state_size() + 1];
+            this->cycles_to_tick = state[state_size() + 2];
+            this->pending_outputs.clear();
+        }
+
+        /// the address of the tested opcode in a state
+        size_t opcode_offset() const{
+            return offsetof(chip8::machine_state, memory) + this->program_start + 0x40;
+        }
+
+        /// the operation the interpreter executes for an opcode
+        chip8::operation decoded(uint16_t opcode) const{
+            return instruction_set::decode_instruction(static_cast<const instruction_set &>(*this), opcode).op;
+        }
+};
+
+/// the result of executing one opcode
+struct opcode_result{
+    std::vector<uint8_t> state;
+    int return_value = 0;
+    std::string error;
+
+    bool operator==(const opcode_result &) const = default;
+};
+
+/// an interpreter of a mode under test
+class decoder_target{
+    public:
+        /// e.g. "specialized table"
+        std::string name;
+
+        virtual ~decoder_target() = default;
+
+        virtual chip8::operation decode(uint16_t opcode) const = 0;
+        /// execute the opcode at pc of a state
+        virtual opcode_result execute(const std::vector<uint8_t> &state) = 0;
+        /// the state every opcode starts from
+        virtual std::vector<uint8_t> start_state() = 0;
+        virtual size_t opcode_offset() const = 0;
+};
+
+/// an interpreter of a mode with one of the decoders, with its own Lua state for the callbacks
+template<class instruction_set, class quirks> class decoder_instance : public decoder_target{
+    public:
+        decoder_instance(const std::filesystem::path &mode, bool table_decoder, const std::string &name) :
+            L(chip8::load_mode(mode)), f(1, 1, 1, 60){
+            this->name = name;
+
+            // the callbacks of some modes print their outputs
+            luaL_dostring(L, "print = function() end");
+
+            chip8::mode_config config(L);
+            config.table_decoder = table_decoder;
+            // the timers must not tick with the host clock between the two runs
+            config.timers = "cycles";
+            config.block_engine = false;
+            config.jit = false;
+            config.seed = 1;
+            c8 = std::make_unique<decoder_probe<instruction_set, quirks>>(config, L);
+        }
+
+        ~decoder_instance(){
+            c8.reset();
+            lua_close(L);
+        }
+
+        chip8::operation decode(uint16_t opcode) const override{
+            return c8->decoded(opcode);
+        }
+
+        opcode_result execute(const std::vector<uint8_t> &state) override{
+            opcode_result result;
+            c8->set_state(state);
+            try{
+                result.return_value = c8->execute(f);
+            }catch(std::exception &e){
+                result.error = e.what();
+            }
+            result.state = c8->get_state();
+            return result;
+        }
+
+        /**
+         * @brief the state every opcode starts from
+         *
+         * The registers hold different values, I points behind the program and the opcode is executed in a subroutine,
+         * so that the opcodes have something to work on.
+         */
+        std::vector<uint8_t> start_state() override{
+            uint16_t start = c8->get_program_start();
+
+            std::vector<uint8_t> setup;
+            for(uint8_t x = 0; x < 16; x++){
+                setup.push_back(0x60 | x);
+                setup.push_back(x * 17 + 3);
+            }
+            uint16_t data = start + 0x80, subroutine = start + 0x40;
+            setup.push_back(0xa0 | (data >> 8));
+            setup.push_back(data & 0xff);
+            setup.push_back(0x20 | (subroutine >> 8));
+            setup.push_back(subroutine & 0xff);
+            c8->load_program(setup);
+
+            for(size_t i = 0; i < setup.size() / 2; i++){
+                c8->execute(f);
+            }
+
+            return c8->get_state();
+        }
+
+        size_t opcode_offset() const override{
+            return c8->opcode_offset();
+        }
+
+    private:
+        lua_State *L;
+        std::unique_ptr<decoder_probe<instruction_set, quirks>> c8;
+        frontend_headless f;
+};
+
+using generic_instance = decoder_instance<chip8::chip8_instruction_set, chip8::chip8_quirks>;
+
+/// add the specialization chip8 runs a mode with, if there is one, with both decoders
+template<class... specializations> void add_specialized(std::tuple<specializations...>, const std::filesystem::path &mode, const chip8::mode_config &config,
+    std::vector<std::unique_ptr<decoder_target>> &targets){
+    auto add = [&]<class instruction_set, class quirks>(chip8::specialization<instruction_set, quirks>){
+        targets.push_back(std::make_unique<decoder_instance<instruction_set, quirks>>(mode, false, "specialized cascade"));
+        targets.push_back(std::make_unique<decoder_instance<instruction_set, quirks>>(mode, true, "specialized table"));
+    };
+    // the first match, like run_specialized() in chip8
+    ((specializations::matches(config.instruction_set_flags, config.quirk_flags) && (add(specializations{}), true)) || ...);
+}
+
+/// print the first differences of a mode
+bool report(const std::filesystem::path &mode, int &differences, uint16_t opcode, const std::string &what){
+    if(differences++ < 10){
+        std::cerr << mode.stem().string() << ": " << std::hex << std::setw(4) << std::setfill('0') << opcode << std::dec << std::setfill(' ') << " " << what << "\n";
+    }
+    return false;
+}
+
+/// compare the decoders on every opcode of a mode, returns the number of differences
+int test_mode(const std::filesystem::path &mode){
+    uint32_t flags;
+    chip8::mode_config config;
+    {
+        lua_State *L = chip8::load_mode(mode);
+        config = chip8::mode_config(L);
+        flags = config.instruction_set_flags;
+        lua_close(L);
+    }
+
+    // the generic cascade is the reference for the execution, it is checked against the original decoder like the others
+    generic_instance reference(mode, false, "cascade");
+    std::vector<std::unique_ptr<decoder_target>> targets;
+    targets.push_back(std::make_unique<generic_instance>(mode, true, "table"));
+    add_specialized(chip8::specializations{}, mode, config, targets);
+
+    std::vector<uint8_t> state = reference.start_state();
+    size_t opcode_offset = reference.opcode_offset();
+
+    int differences = 0;
+    for(uint32_t opcode = 0; opcode < 0x10000; opcode++){
+        chip8::operation expected = reference_decode(flags, opcode);
+        if(reference.decode(opcode) != expected) report(mode, differences, opcode, "decoded differently by the cascade");
+        for(const std::unique_ptr<decoder_target> &target : targets){
+            if(target->decode(opcode) != expected) report(mode, differences, opcode, "decoded differently by the " + target->name);
+        }
+
+        state[opcode_offset] = opcode >> 8;
+        state[opcode_offset + 1] = opcode & 0xff;
+
+        opcode_result reference_result = reference.execute(state);
+        for(const std::unique_ptr<decoder_target> &target : targets){
+            opcode_result result = target->execute(state);
+            if(result == reference_result) continue;
+
+            report(mode, differences, opcode, "differs, " + target->name + ": " + (result.error.empty() ? "no error" : result.error)
+            + ", cascade: " + (reference_result.error.empty() ? "no error" : reference_result.error));
+        }
+    }
+    std::cout << mode.stem().string() << " (" << targets.size() + 1 << " interpreters): ";
+    return differences;
+}
+
+int main(int argc, char* argv[]){
+    if(argc < 2){
+        std::cerr << "usage: " << argv[0] << " modes_directory\n";
+        return 1;
+    }
+
+    std::vector<std::filesystem::path> modes;
+    for(const std::filesystem::directory_entry &entry : std::filesystem::directory_iterator(argv[1])){
+        if(entry.path().extension() == ".lua") modes.push_back(entry.path());
+    }
+    std::sort(modes.begin(), modes.end());
+
+    int failed = 0;
+    try{
+        for(const std::filesystem::path &mode : modes){
+            int differences = test_mode(mode);
+            std::cout << (differences ? std::to_string(differences) + " differences" : "ok") << std::endl;
+            if(differences) failed++;
+        }
+    }catch(std::runtime_error &e){
+        std::cerr << e.what() << "\n";
+        return 1;
+    }
+
+    return failed ? 1 : 0;
+}